@@ -0,0 +1,580 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "lefer.hpp"
+
+#define FNL_IMPL
+#include "./../FastNoiseLite.h"
+
+
+// Every allocation made by the program goes through these operators, so the benchmarks can count them
+static std::atomic<long> n_allocations(0);
+
+void* operator new(std::size_t size) {
+	n_allocations++;
+	void* p = std::malloc(size > 0 ? size : 1);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+
+
+static std::vector<double> noise_field(int field_width, int field_height, int seed) {
+	std::vector<double> angles(field_width * field_height);
+	fnl_state noise = fnlCreateState();
+	noise.seed = seed;
+	noise.noise_type = FNL_NOISE_PERLIN;
+	for (int y = 0; y < field_height; y++) {
+		for (int x = 0; x < field_width; x++) {
+			angles[x + field_width * y] = fnlGetNoise2D(&noise, x, y) * 2 * M_PI;
+		}
+	}
+	return angles;
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+
+
+// Cost of each sampling mode of the flow field, per sample
+static void benchmark_sampling() {
+	int field_width = 120;
+	int field_height = 120;
+	int n_samples = 2000000;
+	lefer::FlowField flow_field = lefer::FlowField(noise_field(field_width, field_height, 50), field_width, field_height);
+	flow_field.precompute_directions();
+
+	std::vector<lefer::Point> points(n_samples);
+	unsigned int state = 12345;
+	for (int i = 0; i < n_samples; i++) {
+		state = state * 1664525u + 1013904223u;
+		double x = (state >> 8) * (field_width / 16777216.0);
+		state = state * 1664525u + 1013904223u;
+		double y = (state >> 8) * (field_height / 16777216.0);
+		points[i] = {x, y};
+	}
+
+	const char* names[] = {"nearest", "bilinear", "bicubic"};
+	lefer::SamplingMode modes[] = {
+		lefer::SamplingMode::nearest,
+		lefer::SamplingMode::bilinear,
+		lefer::SamplingMode::bicubic
+	};
+	std::cout << "# Flow field sampling (" << n_samples << " samples)" << std::endl;
+	for (int m = 0; m < 3; m++) {
+		double checksum = 0.0;
+		auto start = std::chrono::steady_clock::now();
+		for (lefer::Point& p: points) {
+			lefer::Point d = flow_field.sample_direction(p.x, p.y, modes[m]);
+			checksum += d.x + d.y;
+		}
+		double ms = elapsed_ms(start);
+		std::cout << names[m] << ": "
+			<< (ms * 1e6 / n_samples) << " ns/sample"
+			<< " (checksum " << checksum << ")"
+			<< std::endl;
+	}
+}
+
+
+
+// Cost of `collect_seedpoints()`, compared to the trigonometric formulation it replaced (`atan2()`, then `cos()` and `sin()`)
+static void benchmark_seedpoints() {
+	int field_width = 300;
+	int field_height = 300;
+	int n_rounds = 20;
+	double d_sep = 0.8;
+	lefer::FlowField flow_field = lefer::FlowField(noise_field(field_width, field_height, 50), field_width, field_height);
+	lefer::DensityGrid density_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+	lefer::CurveSet curves = lefer::even_spaced_curve_set(45.0, 24.0, 100000, 30, 5, 1.2, d_sep, &flow_field, &density_grid);
+	std::cout << "# Seed points (" << curves.size() << " curves, " << n_rounds << " rounds)" << std::endl;
+
+	lefer::SeedPointsQueue queue = lefer::SeedPointsQueue(30);
+	long n_seeds = 0;
+	double checksum = 0.0;
+	auto start = std::chrono::steady_clock::now();
+	for (int r = 0; r < n_rounds; r++) {
+		for (int c = 0; c < curves.size(); c++) {
+			lefer::collect_seedpoints(curves[c], d_sep, &queue);
+			n_seeds += queue._points.size();
+			checksum += queue._points.empty() ? 0.0 : queue._points.back().x;
+		}
+	}
+	double ms = elapsed_ms(start);
+
+	std::vector<lefer::Point> trig_seeds;
+	double max_difference = 0.0;
+	start = std::chrono::steady_clock::now();
+	for (int r = 0; r < n_rounds; r++) {
+		for (int c = 0; c < curves.size(); c++) {
+			lefer::CurveView curve = curves[c];
+			trig_seeds.clear();
+			for (int i = 0; i < curve.steps_taken() - 1; i++) {
+				double angle = atan2(curve.y[i + 1] - curve.y[i], curve.x[i + 1] - curve.x[i]);
+				trig_seeds.push_back({curve.x[i] + d_sep * cos(angle + M_PI / 2), curve.y[i] + d_sep * sin(angle + M_PI / 2)});
+				trig_seeds.push_back({curve.x[i] + d_sep * cos(angle - M_PI / 2), curve.y[i] + d_sep * sin(angle - M_PI / 2)});
+			}
+			checksum += trig_seeds.empty() ? 0.0 : trig_seeds.back().x;
+			if (r == 0) {
+				lefer::collect_seedpoints(curve, d_sep, &queue);
+				for (size_t i = 0; i < trig_seeds.size(); i++) {
+					double dx = fabs(trig_seeds[i].x - queue._points[i].x);
+					double dy = fabs(trig_seeds[i].y - queue._points[i].y);
+					max_difference = dx > max_difference ? dx : max_difference;
+					max_difference = dy > max_difference ? dy : max_difference;
+				}
+			}
+		}
+	}
+	double trig_ms = elapsed_ms(start);
+
+	std::cout << "collect_seedpoints: " << (ms * 1e6 / n_seeds) << " ns/seed" << std::endl;
+	std::cout << "atan2 + cos + sin: " << (trig_ms * 1e6 / n_seeds) << " ns/seed, "
+		<< "speedup " << (trig_ms / ms) << "x, "
+		<< "max difference " << max_difference
+		<< " (checksum " << checksum << ")"
+		<< std::endl;
+}
+
+
+
+// Effect of the seed point options of `even_spaced_curves()` on a layout with small steps
+static void benchmark_seed_options() {
+	int field_width = 300;
+	int field_height = 300;
+	double step_length = 0.2;
+	double d_sep = 0.8;
+	lefer::FlowField flow_field = lefer::FlowField(noise_field(field_width, field_height, 50), field_width, field_height);
+	flow_field.precompute_directions();
+	std::cout << "# Seed point options (step_length " << step_length << ", d_sep " << d_sep << ")" << std::endl;
+
+	const char* names[] = {
+		"every segment", "every 4th segment", "every d_sep of arc", "deduplicated"
+	};
+	lefer::SeedOptions options[4];
+	options[1].every_k_steps = 4;
+	options[2].arc_spacing = d_sep;
+	options[3].deduplicate = true;
+	for (int m = 0; m < 4; m++) {
+		lefer::DensityGrid density_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+		lefer::SeedStats stats;
+		auto start = std::chrono::steady_clock::now();
+		lefer::CurveSet curves = lefer::even_spaced_curve_set(
+			45.0, 24.0, 1000000, 150, 25, step_length, d_sep, &flow_field, &density_grid,
+			lefer::SamplingMode::nearest, lefer::Integrator::euler, options[m], &stats
+		);
+		double ms = elapsed_ms(start);
+		std::cout << names[m] << ": " << ms << " ms, "
+			<< curves.size() << " curves, "
+			<< curves.n_points() << " points, "
+			<< stats.generated << " seeds generated, "
+			<< stats.pre_rejected << " pre-rejected, "
+			<< stats.traced << " traced"
+			<< std::endl;
+	}
+}
+
+
+
+// Coverage of the layout with each order of the seed frontier, and with re-seeding from the empty regions of the grid
+static void benchmark_seed_schedule() {
+	int field_width = 300;
+	int field_height = 300;
+	double step_length = 0.5;
+	double d_sep = 0.8;
+	lefer::FlowField flow_field = lefer::FlowField(noise_field(field_width, field_height, 50), field_width, field_height);
+	flow_field.precompute_directions();
+	std::vector<lefer::Point> empty_blocks;
+	int n_blocks = lefer::DensityGrid(field_width, field_height, d_sep, 16).find_empty_blocks(3, &empty_blocks);
+	std::cout << "# Seed schedule (the first curve starts next to a corner)" << std::endl;
+
+	const char* names[] = {"fifo", "centre first", "fifo, reseeded", "centre first, reseeded"};
+	lefer::SeedOptions options[4];
+	options[1].schedule = lefer::SeedSchedule::centre_first;
+	options[2].reseed = true;
+	options[3].schedule = lefer::SeedSchedule::centre_first;
+	options[3].reseed = true;
+	for (int m = 0; m < 4; m++) {
+		lefer::DensityGrid density_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+		lefer::SeedStats stats;
+		auto start = std::chrono::steady_clock::now();
+		lefer::CurveSet curves = lefer::even_spaced_curve_set(
+			3.0, 3.0, 1000000, 60, 10, step_length, d_sep, &flow_field, &density_grid,
+			lefer::SamplingMode::nearest, lefer::Integrator::euler, options[m], &stats
+		);
+		double ms = elapsed_ms(start);
+		int n_empty = density_grid.find_empty_blocks(3, &empty_blocks);
+		std::cout << names[m] << ": " << ms << " ms, "
+			<< curves.size() << " curves, "
+			<< 100.0 * (n_blocks - n_empty) / n_blocks << "% of the blocks covered, "
+			<< stats.traced << " traced, "
+			<< stats.reseeded << " reseeded"
+			<< std::endl;
+	}
+}
+
+
+
+// Coverage of `auto_even_spaced_curves()`, against a single layout started next to a corner
+static void benchmark_auto_coverage() {
+	int field_width = 300;
+	int field_height = 300;
+	int n_steps = 60;
+	int min_steps_allowed = 30;
+	double step_length = 0.5;
+	double d_sep = 0.8;
+	lefer::FlowField flow_field = lefer::FlowField(noise_field(field_width, field_height, 50), field_width, field_height);
+	flow_field.precompute_directions();
+	std::cout << "# Automatic coverage seeding (min_steps_allowed " << min_steps_allowed << ")" << std::endl;
+
+	const char* names[] = {"single start", "single start, reseeded", "automatic"};
+
+	lefer::SeedOptions reseeded;
+	reseeded.reseed = true;
+	for (int m = 0; m < 3; m++) {
+		lefer::DensityGrid density_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+		lefer::SeedStats stats;
+		auto start = std::chrono::steady_clock::now();
+		lefer::CurveSet curves;
+		if (m < 2) {
+			curves = lefer::even_spaced_curve_set(
+				3.0, 3.0, 1000000, n_steps, min_steps_allowed, step_length, d_sep, &flow_field, &density_grid,
+				lefer::SamplingMode::nearest, lefer::Integrator::euler, m == 0 ? lefer::SeedOptions() : reseeded, &stats
+			);
+		} else {
+			curves = lefer::auto_even_spaced_curve_set(
+				1000000, n_steps, min_steps_allowed, step_length, d_sep, &flow_field, &density_grid,
+				lefer::SamplingMode::nearest, lefer::Integrator::euler, lefer::CoverageOptions(), lefer::SeedOptions(), &stats
+			);
+		}
+		double ms = elapsed_ms(start);
+		lefer::EmptyRegionMap empty_regions = lefer::EmptyRegionMap();
+		empty_regions.update(&density_grid);
+		std::cout << names[m] << ": " << ms << " ms, "
+			<< curves.size() << " curves, "
+			<< 100.0 * empty_regions.coverage() << "% of the blocks covered, "
+			<< empty_regions.n_regions() << " empty regions left, "
+			<< stats.reseeded << " seeds from empty regions"
+			<< std::endl;
+	}
+}
+
+
+
+// Speedup of `parallel_even_spaced_curves()` and `speculative_even_spaced_curves()` over `even_spaced_curves()`
+static void benchmark_parallel_layout() {
+	int field_width = 600;
+	int field_height = 600;
+	int n_curves = 1000000;
+	int n_steps = 30;
+	int min_steps_allowed = 5;
+	double step_length = 1.2;
+	double d_sep = 0.8;
+	lefer::FlowField flow_field = lefer::FlowField(noise_field(field_width, field_height, 50), field_width, field_height);
+	flow_field.precompute_directions();
+
+	std::cout << "# Evenly-spaced layout (" << field_width << "x" << field_height << " field)" << std::endl;
+	lefer::DensityGrid density_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+	auto start = std::chrono::steady_clock::now();
+	std::vector<lefer::Curve> curves = lefer::even_spaced_curves(
+		45.0, 24.0, n_curves, n_steps, min_steps_allowed, step_length, d_sep, &flow_field, &density_grid
+	);
+	double sequential_ms = elapsed_ms(start);
+	std::cout << "sequential: " << sequential_ms << " ms, "
+		<< curves.size() << " curves, "
+		<< density_grid.get_stats().points_inserted << " points"
+		<< std::endl;
+
+	int thread_counts[] = {1, 2, 4, 8, 16};
+	for (int n_threads: thread_counts) {
+		lefer::DensityGrid parallel_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+		start = std::chrono::steady_clock::now();
+		curves = lefer::parallel_even_spaced_curves(
+			45.0, 24.0, n_curves, n_steps, min_steps_allowed, step_length, d_sep, &flow_field, &parallel_grid, n_threads
+		);
+		double ms = elapsed_ms(start);
+		std::cout << "tiled, " << n_threads << " threads: " << ms << " ms, "
+			<< curves.size() << " curves, "
+			<< parallel_grid.get_stats().points_inserted << " points, "
+			<< "speedup " << (sequential_ms / ms) << "x"
+			<< std::endl;
+	}
+
+	for (int n_threads: thread_counts) {
+		lefer::DensityGrid parallel_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+		start = std::chrono::steady_clock::now();
+		curves = lefer::speculative_even_spaced_curves(
+			45.0, 24.0, n_curves, n_steps, min_steps_allowed, step_length, d_sep, &flow_field, &parallel_grid, n_threads
+		);
+		double ms = elapsed_ms(start);
+		std::cout << "speculative, " << n_threads << " threads: " << ms << " ms, "
+			<< curves.size() << " curves, "
+			<< parallel_grid.get_stats().points_inserted << " points, "
+			<< "speedup " << (sequential_ms / ms) << "x"
+			<< std::endl;
+	}
+}
+
+
+
+// A small random number generator, so each thread can have its own
+static double random_coord(unsigned int* state, double max) {
+	*state = *state * 1664525u + 1013904223u;
+	return (*state >> 8) * (max / 16777216.0);
+}
+
+// Stress test and throughput of `ConcurrentDensityGrid` with many threads inserting and checking points at once
+static void benchmark_concurrent_grid() {
+	int field_width = 1000;
+	int field_height = 1000;
+	double d_sep = 0.8;
+	int ops_per_thread = 200000;
+	std::cout << "# Concurrent density grid (" << ops_per_thread << " inserts + checks per thread)" << std::endl;
+
+	int thread_counts[] = {1, 2, 4, 8, 16, 32, 64};
+	for (int n_threads: thread_counts) {
+		lefer::ConcurrentDensityGrid grid = lefer::ConcurrentDensityGrid(field_width, field_height, d_sep, 8);
+		std::atomic<long> inserted(0);
+		auto worker = [&](int thread_id) {
+			unsigned int state = 1000 + thread_id;
+			for (int i = 0; i < ops_per_thread; i++) {
+				double x = random_coord(&state, field_width);
+				double y = random_coord(&state, field_height);
+				if (grid.off_boundaries(x, y)) {
+					continue;
+				}
+				grid.insert_coord(x, y);
+				inserted++;
+				grid.is_valid_next_step(x, y);
+				grid.is_valid_next_step(random_coord(&state, field_width), random_coord(&state, field_height));
+			}
+		};
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> threads;
+		for (int t = 0; t < n_threads; t++) {
+			threads.emplace_back(worker, t);
+		}
+		for (std::thread& thread: threads) {
+			thread.join();
+		}
+		double ms = elapsed_ms(start);
+		std::cout << n_threads << " threads: "
+			<< (inserted * 3 / ms / 1000.0) << " Mops/s"
+			<< std::endl;
+	}
+}
+
+
+
+// Starting points of `non_overlapping_curves()`: uniform random points, against Poisson-disc and jittered points
+static void benchmark_starting_points() {
+	int field_width = 600;
+	int field_height = 600;
+	double d_sep = 0.8;
+	lefer::FlowField flow_field = lefer::FlowField(noise_field(field_width, field_height, 50), field_width, field_height);
+	flow_field.precompute_directions();
+	std::cout << "# Starting points of non_overlapping_curves (d_sep " << d_sep << ")" << std::endl;
+
+	for (int m = 0; m < 3; m++) {
+		auto start = std::chrono::steady_clock::now();
+		std::vector<lefer::Point> starting_points;
+		if (m == 1) {
+			starting_points = lefer::poisson_disc_points(field_width, field_height, 4 * d_sep, 777);
+		} else if (m == 2) {
+			starting_points = lefer::jittered_grid_points(field_width, field_height, 5 * d_sep, 777);
+		} else {
+			// As many uniform random points as Poisson-disc points
+			unsigned int state = 777;
+			int n_points = lefer::poisson_disc_points(field_width, field_height, 4 * d_sep, 777).size();
+			for (int i = 0; i < n_points; i++) {
+				starting_points.push_back({random_coord(&state, field_width), random_coord(&state, field_height)});
+			}
+			start = std::chrono::steady_clock::now();
+		}
+		double points_ms = elapsed_ms(start);
+
+		lefer::DensityGrid density_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+		start = std::chrono::steady_clock::now();
+		lefer::CurveSet curves = lefer::non_overlapping_curve_set(starting_points, 30, 5, 1.2, &flow_field, &density_grid);
+		double layout_ms = elapsed_ms(start);
+		lefer::EmptyRegionMap empty_regions = lefer::EmptyRegionMap();
+		empty_regions.update(&density_grid);
+		const char* names[] = {"uniform", "poisson disc", "jittered"};
+		std::cout << names[m] << ": " << starting_points.size() << " points in " << points_ms << " ms, "
+			<< curves.size() << " curves in " << layout_ms << " ms, "
+			<< 100.0 * curves.size() / starting_points.size() << "% of the points accepted, "
+			<< 100.0 * empty_regions.coverage() << "% of the blocks covered"
+			<< std::endl;
+	}
+}
+
+
+
+// Cost of building a new density grid for each layout, compared to resetting the same grid
+static void benchmark_grid_reset() {
+	int field_width = 600;
+	int field_height = 600;
+	int n_runs = 1000;
+	int n_curves = 50;
+	double d_sep = 0.8;
+	lefer::FlowField flow_field = lefer::FlowField(noise_field(field_width, field_height, 50), field_width, field_height);
+	flow_field.precompute_directions();
+	std::cout << "# Density grid reuse (" << n_runs << " layouts of " << n_curves << " curves, "
+		<< field_width << "x" << field_height << " field)" << std::endl;
+
+	long constructed_points = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < n_runs; i++) {
+		lefer::DensityGrid density_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+		lefer::even_spaced_curves(45.0 + (i % 100), 24.0, n_curves, 30, 5, 1.2, d_sep, &flow_field, &density_grid);
+		constructed_points += density_grid.get_stats().points_inserted;
+	}
+	double construct_ms = elapsed_ms(start);
+
+	long reset_points = 0;
+	lefer::DensityGrid density_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < n_runs; i++) {
+		density_grid.reset();
+		lefer::even_spaced_curves(45.0 + (i % 100), 24.0, n_curves, 30, 5, 1.2, d_sep, &flow_field, &density_grid);
+		reset_points += density_grid.get_stats().points_inserted;
+	}
+	double reset_ms = elapsed_ms(start);
+
+	std::cout << "construct per run: " << (construct_ms / n_runs) << " ms/run" << std::endl;
+	std::cout << "reset per run: " << (reset_ms / n_runs) << " ms/run, "
+		<< "speedup " << (construct_ms / reset_ms) << "x"
+		<< (constructed_points == reset_points ? " (same points)" : " (FAILED: different points)")
+		<< std::endl;
+}
+
+
+
+// Throughput of `even_spaced_curves_batch()`, compared to drawing the same layouts one after the other
+static void benchmark_batch() {
+	int field_width = 200;
+	int field_height = 200;
+	int n_jobs = 64;
+	double d_sep = 0.8;
+	std::vector<lefer::FlowField> flow_fields;
+	flow_fields.reserve(n_jobs);
+	std::vector<lefer::CurveJob> jobs;
+	for (int i = 0; i < n_jobs; i++) {
+		flow_fields.emplace_back(noise_field(field_width, field_height, 100 + i), field_width, field_height);
+		flow_fields.back().precompute_directions();
+	}
+	for (int i = 0; i < n_jobs; i++) {
+		jobs.push_back({&flow_fields[i], 45.0, 24.0, 20000, 30, 5, 1.2, d_sep});
+	}
+	std::cout << "# Batch of " << n_jobs << " layouts (" << field_width << "x" << field_height << " fields)" << std::endl;
+
+	auto start = std::chrono::steady_clock::now();
+	long sequential_curves = 0;
+	for (lefer::CurveJob& job: jobs) {
+		lefer::DensityGrid density_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+		sequential_curves += lefer::even_spaced_curves(
+			job.x_start, job.y_start, job.n_curves, job.n_steps, job.min_steps_allowed,
+			job.step_length, job.d_sep, job.flow_field, &density_grid
+		).size();
+	}
+	double sequential_ms = elapsed_ms(start);
+	std::cout << "sequential: " << sequential_ms << " ms, " << sequential_curves << " curves" << std::endl;
+
+	int thread_counts[] = {1, 2, 4, 8, 16};
+	for (int n_threads: thread_counts) {
+		long n_curves = 0;
+		start = std::chrono::steady_clock::now();
+		lefer::even_spaced_curves_batch(jobs, n_threads, 16, [&](int, std::vector<lefer::Curve>&& curves) {
+			n_curves += curves.size();
+		});
+		double ms = elapsed_ms(start);
+		std::cout << "batch, " << n_threads << " threads: " << ms << " ms, "
+			<< n_curves << " curves, "
+			<< (n_jobs * 1000.0 / ms) << " layouts/s, "
+			<< "speedup " << (sequential_ms / ms) << "x"
+			<< std::endl;
+	}
+}
+
+
+
+// Number of allocations made by the sequential layouts, per run and per curve drawn
+static void benchmark_allocations() {
+	int field_width = 300;
+	int field_height = 300;
+	int n_curves = 5000;
+	double d_sep = 0.8;
+	lefer::FlowField flow_field = lefer::FlowField(noise_field(field_width, field_height, 50), field_width, field_height);
+	lefer::DensityGrid density_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+	std::cout << "# Allocations per run (" << field_width << "x" << field_height << " field)" << std::endl;
+
+	// Warm up the density grid, so that only the allocations of the layout itself are counted
+	lefer::even_spaced_curves(45.0, 24.0, n_curves, 30, 5, 1.2, d_sep, &flow_field, &density_grid);
+	density_grid.reset();
+	long start = n_allocations;
+	std::vector<lefer::Curve> curves = lefer::even_spaced_curves(45.0, 24.0, n_curves, 30, 5, 1.2, d_sep, &flow_field, &density_grid);
+	long allocations = n_allocations - start;
+	std::cout << "even_spaced_curves: " << allocations << " allocations, "
+		<< curves.size() << " curves, "
+		<< ((double) allocations / curves.size()) << " per curve"
+		<< std::endl;
+
+	std::vector<lefer::Point> starting_points;
+	unsigned int state = 777;
+	for (int i = 0; i < n_curves; i++) {
+		starting_points.push_back({random_coord(&state, field_width), random_coord(&state, field_height)});
+	}
+	density_grid.reset();
+	start = n_allocations;
+	curves = lefer::non_overlapping_curves(starting_points, 30, 5, 1.2, d_sep, &flow_field, &density_grid);
+	allocations = n_allocations - start;
+	std::cout << "non_overlapping_curves: " << allocations << " allocations, "
+		<< curves.size() << " curves, "
+		<< ((double) allocations / curves.size()) << " per curve"
+		<< std::endl;
+
+	density_grid.reset();
+	start = n_allocations;
+	lefer::CurveSet curve_set = lefer::even_spaced_curve_set(45.0, 24.0, n_curves, 30, 5, 1.2, d_sep, &flow_field, &density_grid);
+	allocations = n_allocations - start;
+	std::cout << "even_spaced_curve_set: " << allocations << " allocations, "
+		<< curve_set.size() << " curves, "
+		<< ((double) allocations / curve_set.size()) << " per curve"
+		<< std::endl;
+}
+
+
+
+int main (int argc, char *argv[]) {
+	benchmark_allocations();
+	benchmark_sampling();
+	benchmark_seedpoints();
+	benchmark_seed_options();
+	benchmark_seed_schedule();
+	benchmark_auto_coverage();
+	benchmark_starting_points();
+	benchmark_parallel_layout();
+	benchmark_concurrent_grid();
+	benchmark_grid_reset();
+	benchmark_batch();
+	return 0;
+}
@@ -35,11 +35,12 @@ int main (int argc, char *argv[]) {
 
 
 	lefer::FlowField flow_field_obj = lefer::FlowField(flow_field, flow_field_width);
-	lefer::DensityGrid density_grid = lefer::DensityGrid(flow_field_width, flow_field_height, d_sep, 2000);
+	flow_field_obj.precompute_directions();
+	lefer::DensityGrid density_grid = lefer::DensityGrid(flow_field_width, flow_field_height, d_sep, 16);
 	
 	double x_start = 45.0;
 	double y_start = 24.0;
-	std::vector<lefer::Curve> curves = lefer::even_spaced_curves(
+	lefer::CurveSet curves = lefer::even_spaced_curve_set(
 		x_start,
 		y_start,
 		n_curves,
@@ -53,13 +54,13 @@ int main (int argc, char *argv[]) {
 
 
 	// Visualizing the coordinates calculated by the algorithm
-	for (lefer::Curve curve: curves) {
-		int curve_id = curve._curve_id;
-		for (int i = 0; i < curve._steps_taken; i++) {
-			std::cout << curve_id << "; "
-				<< curve._x[i] << "; "
-				<< curve._y[i] << "; "
-				<< curve._direction[i] << "; "
+	for (int c = 0; c < curves.size(); c++) {
+		lefer::CurveView curve = curves[c];
+		for (int i = 0; i < curve.steps_taken(); i++) {
+			std::cout << curve.curve_id << "; "
+				<< curve.x[i] << "; "
+				<< curve.y[i] << "; "
+				<< curve.direction(i) << "; "
 				<< std::endl;
 		}
 	}
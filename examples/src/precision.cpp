@@ -0,0 +1,106 @@
+// Compares the single-precision build of the library (`lefer_float`) against the double-precision build:
+// how far the curves drift apart, and how much memory and time a layout takes with each one.
+#include <math.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include "lefer.hpp"
+#include "precision.hpp"
+
+#define FNL_IMPL
+#include "./../FastNoiseLite.h"
+
+
+// Every allocation made by the program goes through these operators, so both builds can measure the memory
+// they actually hold. Each block starts with a header that records its size.
+std::atomic<long> live_bytes(0);
+static const size_t header_size = alignof(std::max_align_t);
+
+void* operator new(std::size_t size) {
+	char* p = (char*) std::malloc(size + header_size);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	*(size_t*) p = size;
+	live_bytes += (long) size;
+	return p + header_size;
+}
+
+void operator delete(void* p) noexcept {
+	if (p == nullptr) {
+		return;
+	}
+	char* block = (char*) p - header_size;
+	live_bytes -= (long) *(size_t*) block;
+	std::free(block);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	operator delete(p);
+}
+
+
+// Defined in `precision_reference.cpp`, which is built with the double-precision library
+PrecisionResults measure_double_precision(const std::vector<double>& angles,
+					  int field_width,
+					  int field_height,
+					  const std::vector<double>& seeds,
+					  double d_sep);
+
+
+int main (int argc, char *argv[]) {
+	static_assert(sizeof(lefer::real_t) == sizeof(float), "precision.cpp must be built with LEFER_SINGLE_PRECISION");
+
+	int field_width = 600;
+	int field_height = 600;
+	int n_seeds = 2000;
+	double d_sep = 0.8;
+	std::vector<double> angles((size_t) field_width * field_height);
+	fnl_state noise = fnlCreateState();
+	noise.seed = 50;
+	noise.noise_type = FNL_NOISE_PERLIN;
+	for (int y = 0; y < field_height; y++) {
+		for (int x = 0; x < field_width; x++) {
+			angles[x + field_width * y] = fnlGetNoise2D(&noise, x, y) * 2 * M_PI;
+		}
+	}
+	std::vector<double> seeds;
+	unsigned int state = 12345;
+	for (int i = 0; i < n_seeds * 2; i++) {
+		state = state * 1664525u + 1013904223u;
+		seeds.push_back((state >> 8) * ((i % 2 == 0 ? field_width : field_height) / 16777216.0));
+	}
+
+	PrecisionResults reference = measure_double_precision(angles, field_width, field_height, seeds, d_sep);
+	PrecisionResults single = measure_precision(angles, field_width, field_height, seeds, d_sep);
+
+	CurveDeviation deviation = compare_traced_curves(reference.traced, single.traced);
+
+	std::cout << "# Geometric deviation of float vs double (" << n_seeds << " curves of up to 200 steps, "
+		<< field_width << "x" << field_height << " field)" << std::endl;
+	std::cout << "mean deviation: " << deviation.mean_deviation << " units" << std::endl;
+	std::cout << "max deviation: " << deviation.max_deviation << " units (" << (deviation.max_deviation / d_sep) << " d_sep)" << std::endl;
+	std::cout << "curves with the same number of points: " << deviation.n_same_length << " of " << n_seeds << std::endl;
+
+	std::cout << "# Evenly-spaced layout, double vs float" << std::endl;
+	const char* names[] = {"double", "float"};
+	PrecisionResults* results[] = {&reference, &single};
+	for (int r = 0; r < 2; r++) {
+		std::cout << names[r] << ": "
+			<< results[r]->layout_ms << " ms, "
+			<< results[r]->layout_curves << " curves, "
+			<< results[r]->layout_points << " points, "
+			<< (results[r]->layout_bytes / (1024.0 * 1024.0)) << " MiB, "
+			<< "min distance between curves " << results[r]->layout_min_distance
+			<< std::endl;
+	}
+	std::cout << "float speedup: " << (reference.layout_ms / single.layout_ms) << "x, "
+		<< "memory: " << (100.0 * single.layout_bytes / reference.layout_bytes) << "% of double"
+		<< std::endl;
+
+	return 0;
+}
@@ -0,0 +1,56 @@
+// The measurements compared by the `precision` executable. This header is included by two translation units,
+// one built with the double-precision library, and one built with the single-precision library, so that
+// `measure_precision()` is compiled once for each precision (it is `static`, so each unit has its own copy).
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "curve_checks.hpp"
+
+
+//! The bytes allocated with `new` and not freed yet, counted by the `operator new` of `precision.cpp`
+extern std::atomic<long> live_bytes;
+
+
+struct PrecisionResults {
+	//! The curves drawn from each seed point on an empty field
+	TracedCurves traced;
+	double layout_ms;
+	int layout_curves;
+	size_t layout_points;
+	//! The bytes held by the flow field, the density grid and the curves once the layout is done
+	size_t layout_bytes;
+	//! The smallest distance between two points of different curves of the layout
+	double layout_min_distance;
+};
+
+
+static PrecisionResults measure_precision(const std::vector<double>& angles,
+					  int field_width,
+					  int field_height,
+					  const std::vector<double>& seeds,
+					  double d_sep) {
+
+	PrecisionResults results;
+	long field_start = live_bytes;
+	std::vector<lefer::real_t> field(angles.begin(), angles.end());
+	lefer::FlowField flow_field = lefer::FlowField(std::move(field), field_width, field_height);
+	flow_field.precompute_directions();
+	long field_bytes = live_bytes - field_start;
+
+	// The same seed points, traced over an empty density grid, measure the error of the integration alone
+	results.traced = trace_from_seeds(&flow_field, seeds, d_sep);
+
+	long layout_start = live_bytes;
+	lefer::DensityGrid density_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+	auto start = std::chrono::steady_clock::now();
+	lefer::CurveSet curves = lefer::even_spaced_curve_set(45.0, 24.0, 1000000, 30, 5, 1.2, d_sep, &flow_field, &density_grid);
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	results.layout_ms = elapsed.count();
+	results.layout_curves = curves.size();
+	results.layout_points = curves.n_points();
+	results.layout_bytes = (size_t) (field_bytes + live_bytes - layout_start);
+	results.layout_min_distance = min_distance_between_curves(curves, field_width, field_height, d_sep);
+	return results;
+}
@@ -0,0 +1,14 @@
+// The double-precision side of the `precision` executable (see `precision.cpp`)
+#include <math.h>
+
+#include "lefer.hpp"
+#include "precision.hpp"
+
+
+PrecisionResults measure_double_precision(const std::vector<double>& angles,
+					  int field_width,
+					  int field_height,
+					  const std::vector<double>& seeds,
+					  double d_sep) {
+	return measure_precision(angles, field_width, field_height, seeds, d_sep);
+}
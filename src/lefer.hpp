@@ -1,32 +1,108 @@
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
 #include <vector>
 
 
 namespace lefer {
+#ifdef LEFER_SINGLE_PRECISION
+// Keeps the symbols of a single-precision build apart from the ones of a double-precision build
+inline namespace single_precision {
+#endif
+
+/*! The type used to store angles and coordinates, i.e., the flow field, the density grid and the curves.
+ *
+ * It is `double` by default. If you define `LEFER_SINGLE_PRECISION` (or link against the `lefer_float` target),
+ * it is `float`, which halves the memory used by all of these objects, and doubles the number of points that the
+ * proximity kernels test at once. The calculations along each step of a curve are still done in double precision.
+ */
+#ifdef LEFER_SINGLE_PRECISION
+typedef float real_t;
+#else
+typedef double real_t;
+#endif
 
 double distance (double x1, double y1, double x2, double y2);
-static int _grid_index_as_1d(int x, int y, int grid_width);
+bool any_point_within (const real_t* xs, const real_t* ys, int n, double x, double y, double d_test2);
+inline int _grid_index_as_1d(int x, int y, int grid_width);
+
+
+struct Point {
+	double x;
+	double y;
+};
+
+
+/*! The methods available to sample the direction of the flow field at a point */
+enum class SamplingMode {
+	//! Use the direction of the cell that contains the point
+	nearest,
+	//! Interpolate the directions of the 4 closest cells
+	bilinear,
+	//! Interpolate the directions of the 16 closest cells with a Catmull-Rom spline
+	bicubic
+};
+
+
+/*! The numerical methods available to integrate the curves through the flow field */
+enum class Integrator {
+	//! Explicit Euler method, i.e., one sample of the field per step
+	euler,
+	//! Midpoint method (second order Runge-Kutta), two samples per step
+	midpoint,
+	//! Classic fourth order Runge-Kutta, four samples per step
+	rk4,
+	//! Runge-Kutta-Fehlberg 4(5), which shrinks the steps where the field changes too fast, six samples per step
+	rk45
+};
 
 
 class FlowField {
 private:
-	double** _flow_field;
+	//! The angles of the field, stored in row-major order, i.e., the angle at (x, y) is `_angles[x + _field_width * y]`
+	const real_t* _angles;
+	//! The buffer that holds the angles when the field owns them (it is empty when the field is a view over a buffer owned by the caller)
+	std::vector<real_t> _owned_angles;
+	//! The unit vector (cos, sin) of the angle of each cell, interleaved and in row-major order (it is empty until `precompute_directions()` is called)
+	std::vector<real_t> _directions;
 	int _field_width;
+	int _field_height;
 public:
 	FlowField(double** flow_field, int field_width);
+	FlowField(double** flow_field, int field_width, int field_height);
+	FlowField(const real_t* flow_field, int field_width, int field_height);
+	FlowField(std::vector<real_t> flow_field, int field_width, int field_height);
+	FlowField(const FlowField& other);
+	FlowField& operator=(const FlowField& other);
+	// Moving a vector keeps its buffer, so `_angles` stays valid when it points into `_owned_angles`
+	FlowField(FlowField&& other) noexcept = default;
+	FlowField& operator=(FlowField&& other) noexcept = default;
 	int get_field_width();
+	int get_field_height();
 	int get_flow_field_col(double x);
 	int get_flow_field_row(double y);
 	bool off_boundaries(double x, double y);
 	double get_angle(double x, double y);
+	void precompute_directions();
+	bool has_directions();
+	Point get_direction(double x, double y);
+	Point get_cell_direction(int col, int row);
+	Point sample_direction(double x, double y, SamplingMode sampling);
 };
 
-struct Point {
-	double x;
-	double y;
-};
-
-
-/*! A class that represents a curve */
+/*! A class that represents a curve
+ *
+ * The points of the curve are stored in the order of the path, i.e., from the end of the half
+ * drawn from right to left, through the starting point (at `_seed_index`), up to the end of the
+ * half drawn from left to right. So you can use them as a polyline, without sorting them first.
+ */
 class Curve {
 public:
 	//! The id that identifies the curve
@@ -37,45 +113,317 @@ public:
 	std::vector<int> _step_id; 
 	//! The number of steps taken to draw the curve.
 	int _steps_taken; 
+	//! The index of the starting point of the curve (the points before it were drawn from right to left)
+	int _seed_index;
 	//! The x coordinates of each point in the curve
-	std::vector<double> _x; 
+	std::vector<real_t> _x; 
 	//! The y coordinates of each point in the curve
-	std::vector<double> _y; 
+	std::vector<real_t> _y; 
 
 public:
 	Curve(int id, int n_steps);
 	void insert_step(double x_coord, double y_coord, int direction_id);
+	void reset(int id, int n_steps);
+};
+
+
+/*! A read-only view over the points of one curve of a `lefer::CurveSet`
+ *
+ * The points are in the order of the path (see `lefer::Curve`), and the step id of each point
+ * is simply its index in the view. The points before `split` (the starting point included) were
+ * drawn from right to left (direction 0), and the points from `split` onwards were drawn from
+ * left to right (direction 1).
+ */
+struct CurveView {
+	//! The id that identifies the curve
+	int curve_id;
+	//! The x coordinates of each point in the curve
+	std::span<const real_t> x;
+	//! The y coordinates of each point in the curve
+	std::span<const real_t> y;
+	//! The index of the first point drawn from left to right
+	int split;
+
+	int steps_taken() const;
+	int seed_index() const;
+	int direction(int i) const;
 };
 
 
-class DensityCell {
+/*! The curves of a layout, with the points of all curves stored in a single contiguous buffer
+ *
+ * A `std::vector<lefer::Curve>` allocates four vectors for each curve. A `CurveSet` stores the x and y
+ * coordinates of all curves one after the other, in two arrays, and keeps only the offset of each curve
+ * into these arrays, and the index where each curve changes direction. The id of each curve is its index in the set.
+ */
+class CurveSet {
 public:
-	std::vector<double> x;
-	std::vector<double> y;
-	int capacity;
-	int space_used;
+	//! The x coordinates of the points of all curves, one curve after the other
+	std::vector<real_t> _x;
+	//! The y coordinates of the points of all curves, one curve after the other
+	std::vector<real_t> _y;
+	//! The points of the curve `i` are at the positions `_offsets[i]` up to `_offsets[i + 1] - 1` of `_x` and `_y`
+	std::vector<size_t> _offsets;
+	//! The index (inside each curve) of the first point drawn from left to right
+	std::vector<int> _splits;
+
 public:
-	DensityCell(int cell_capacity);
+	CurveSet();
+	int size() const;
+	size_t n_points() const;
+	CurveView get_curve(int i) const;
+	CurveView operator[](int i) const;
+	void reserve(int n_curves);
+	void append(const Curve* curve);
+	void clear();
+	std::vector<Curve> to_curves() const;
+};
+
+
+/*! Counters that describe how the memory of a `lefer::DensityGrid` is being used */
+struct DensityGridStats {
+	//! The number of points stored in the grid
+	long points_inserted;
+	//! The number of cells that store at least one point
+	int cells_used;
+	//! The total number of slabs taken from the slab buffer
+	int slabs_allocated;
+	//! The number of slabs that were chained to a cell because its previous slabs were full
+	int overflow_slabs;
+	//! The number of points stored in the most crowded cell
+	int max_cell_size;
 };
 
 
 class DensityGrid {
 private:
-	std::vector<DensityCell> _grid;
+	//! The cell (or "record") that stores the points of each position of a dense grid (-1 means that the position is still empty)
+	std::vector<int> _cell_record;
+	//! A packed bitmap with one bit per position of a dense grid, which is set when the position stores at least one point
+	std::vector<uint64_t> _occupancy;
+	//! The keys of the open-addressing hash table used by a sparse grid (-1 means that the bucket is empty)
+	std::vector<int64_t> _hash_keys;
+	//! The cell stored at each bucket of the hash table used by a sparse grid
+	std::vector<int> _hash_records;
+	int _hash_used;
+	//! The index of the first slab of each cell
+	std::vector<int> _record_head;
+	//! The index of the last slab in the chain of slabs of each cell
+	std::vector<int> _record_tail;
+	//! The number of points stored in each cell
+	std::vector<int> _record_size;
+	//! The bounding box (min x, min y, max x, max y) of the points of each cell
+	std::vector<real_t> _record_bbox;
+	//! The position (dense grid) or the hash bucket (sparse grid) of each cell, i.e., the list of cells that `reset()` must clear
+	std::vector<int> _record_cell;
+	//! The index of the next slab in the chain (-1 means that this is the last slab of the cell)
+	std::vector<int> _slab_next;
+	//! The x coordinates of every point inserted in the grid, stored in contiguous slabs of `_cell_capacity` entries
+	std::vector<real_t> _slab_x;
+	//! The y coordinates of every point inserted in the grid, stored in contiguous slabs of `_cell_capacity` entries
+	std::vector<real_t> _slab_y;
+	int _cell_capacity;
+	int _n_slabs;
+	DensityGridStats _stats;
+	bool _sparse;
 	int _width;
 	int _height;
-	int _n_elements;
+	//! The number of positions of a dense grid (it is always 0 for a sparse grid, which has no storage per position)
+	size_t _n_elements;
+	int _flow_field_width;
+	int _flow_field_height;
 	double _d_sep;
+	double _d_test;
+	double _d_test2;
+
+	void _set_geometry(double d_sep);
+	int _find_cell(int col, int row);
+	int _find_or_create_cell(int col, int row, double x, double y);
+	void _grow_hash_table();
 public:
-	DensityGrid(int flow_field_width, int flow_field_height, double d_sep, int cell_capacity);
+	DensityGrid(int flow_field_width, int flow_field_height, double d_sep, int cell_capacity, bool sparse = false);
 	int get_density_col (double x);
 	int get_density_row (double y);
 	int get_density_index (double x, double y);
 	int get_density_index (int col, int row);
 	bool off_boundaries(double x, double y);
+	bool is_sparse();
+	int get_width();
+	int get_height();
+	double get_d_sep();
+	bool is_cell_occupied(int col, int row);
+	void mark_occupied_blocks(int block_size, std::vector<uint64_t>* occupied);
+	int find_empty_blocks(int block_size, std::vector<Point>* centres);
 	void insert_coord(double x, double y);
 	void insert_curve_coords(Curve* curve);
 	bool is_valid_next_step(double x, double y);
+	bool is_valid_next_step(double x, double y, std::span<const Point> ignored);
+	DensityGridStats get_stats();
+	void reset();
+	void reset(double d_sep);
+};
+
+
+
+/*! A coarse map of the regions of a `lefer::DensityGrid` that store no point
+ *
+ * The density grid is split into blocks of `_block_size` x `_block_size` cells. Empty blocks that are
+ * next to each other (up, down, left or right) belong to the same region. The map is a snapshot:
+ * call `update()` again after inserting curves into the grid.
+ *
+ * The map is dense: it stores about 20 bytes for each block of the whole field, even when the density grid
+ * is sparse. On a sparse grid of a very large field, use larger blocks (or no map at all), since the memory of the
+ * map grows with the area of the field, not with the number of points stored in the grid.
+ */
+class EmptyRegionMap {
+public:
+	int _block_size;
+	int _cols;
+	int _rows;
+	double _d_sep;
+	long _n_empty;
+	//! The region of each block, in row-major order (-1 means that the block stores at least one point)
+	std::vector<int> _region;
+	//! The number of blocks of each region
+	std::vector<long> _region_size;
+	//! The block of each region that is the farthest from any point of the grid (and from the borders of the map), among the blocks not tried yet (-1 means that every block of the region was tried)
+	std::vector<long> _region_centre;
+	//! Whether a curve was already started from each block (see `mark_tried()`), which is kept across updates
+	std::vector<char> _tried;
+	//! The distance (in blocks) from each block to the nearest block that is not empty, or to the borders of the map
+	std::vector<int> _depth;
+	//! The blocks that store at least one point (see `lefer::DensityGrid::mark_occupied_blocks()`)
+	std::vector<uint64_t> _occupied;
+	std::vector<size_t> _stack;
+
+public:
+	EmptyRegionMap(int block_size = 3);
+	void update(DensityGrid* density_grid);
+	long n_blocks();
+	long n_empty();
+	int n_regions();
+	double coverage();
+	int largest_regions(int max_regions, std::vector<Point>* centres);
+	void mark_tried(Point p);
+};
+
+
+
+/*! A group of slabs of a `lefer::ConcurrentDensityGrid`, allocated at once */
+struct ConcurrentSlabSegment {
+	//! The x coordinates of the points stored in the slabs of this segment
+	std::unique_ptr<real_t[]> x;
+	//! The y coordinates of the points stored in the slabs of this segment
+	std::unique_ptr<real_t[]> y;
+	//! The index of the next slab in the chain of each slab of this segment (-1 means that this is the last slab of the cell)
+	std::unique_ptr<std::atomic<int>[]> next;
+};
+
+
+class ConcurrentDensityGrid {
+private:
+	//! The number of segments, which is enough to store any number of slabs that fits in an `int`
+	static const int N_SEGMENTS = 32;
+	//! The number of slabs in the first segment (each segment has twice the slabs of the previous one)
+	static const int FIRST_SEGMENT_SLABS = 1024;
+	//! The number of locks used to protect the cells (cells are mapped to locks by regions of 4x4 cells)
+	static const int N_LOCKS = 256;
+
+	//! The index of the first slab of each cell (-1 means that the cell is still empty)
+	std::unique_ptr<std::atomic<int>[]> _cell_head;
+	//! The number of points of each cell that are visible to the readers
+	std::unique_ptr<std::atomic<int>[]> _cell_size;
+	//! The index of the last slab of each cell (only accessed while holding the lock of the cell)
+	std::unique_ptr<int[]> _cell_tail;
+	std::unique_ptr<std::mutex[]> _locks;
+	std::atomic<ConcurrentSlabSegment*> _segments[N_SEGMENTS];
+	std::mutex _segments_lock;
+	std::atomic<int> _n_slabs;
+	std::atomic<long> _n_points;
+	int _cell_capacity;
+	int _width;
+	int _height;
+	int _n_elements;
+	double _d_sep;
+	double _d_test;
+	double _d_test2;
+
+	int _allocate_slab();
+	ConcurrentSlabSegment* _slab_segment(int slab, int* offset);
+public:
+	ConcurrentDensityGrid(int flow_field_width, int flow_field_height, double d_sep, int cell_capacity);
+	~ConcurrentDensityGrid();
+	ConcurrentDensityGrid(const ConcurrentDensityGrid&) = delete;
+	ConcurrentDensityGrid& operator=(const ConcurrentDensityGrid&) = delete;
+	int get_density_col (double x);
+	int get_density_row (double y);
+	int get_density_index (int col, int row);
+	bool off_boundaries(double x, double y);
+	void insert_coord(double x, double y);
+	void insert_curve_coords(Curve* curve);
+	bool is_valid_next_step(double x, double y);
+	long get_n_points();
+	void get_cell_points(int col, int row, std::vector<Point>* points);
+};
+
+
+
+/*! The order in which `lefer::even_spaced_curves()` traces the seed points of the layout */
+enum class SeedSchedule {
+	//! Seed points are traced in the order they were produced, i.e., breadth-first from the first curve (the default)
+	fifo,
+	//! Seed points that are closer to the centre of the field are traced first, whichever curve produced them
+	centre_first
+};
+
+
+/*! Which seed points `lefer::even_spaced_curves()` tries around each curve
+ *
+ * By default, every segment of a curve produces two seed points (one on each side). With small steps,
+ * consecutive seed points are almost identical, so most of them are rejected right away. These options
+ * thin out the seed points before any curve is drawn from them.
+ */
+struct SeedOptions {
+	//! Only one segment out of every `every_k_steps` segments of the curve produces seed points
+	int every_k_steps = 1;
+	//! If positive, a segment produces seed points only if the arc walked since the last segment that did is at least this long (usually, `d_sep`)
+	double arc_spacing = 0.0;
+	//! Drop each seed point that is within `d_sep` of a seed point kept earlier around the same curve (see `lefer::deduplicate_seedpoints()`)
+	bool deduplicate = false;
+	//! The order in which the seed points of all curves are traced
+	SeedSchedule schedule = SeedSchedule::fifo;
+	//! When there is no seed point left, start new curves from the empty regions of the density grid
+	bool reseed = false;
+	//! The size, in cells of the density grid, of the empty blocks searched by `reseed`. With an odd size of 3 or more,
+	//! the centre of an empty block is always a valid next step. Larger blocks are faster to scan, but miss the smaller gaps.
+	//! A size below 1 is treated as 3
+	int reseed_block_size = 3;
+};
+
+
+/*! How `lefer::auto_even_spaced_curves()` chooses the starting points of its root curves */
+struct CoverageOptions {
+	//! The maximum number of root curves that are started into the empty regions of the density grid
+	int max_roots = 256;
+	//! The maximum number of root curves started at each round (one into each of the largest empty regions). A value below 1 is treated as 1
+	int roots_per_round = 16;
+	//! The size, in cells of the density grid, of the blocks of the empty-region map (see `lefer::EmptyRegionMap`). A size below 1 is treated as 3
+	int block_size = 3;
+	//! The layout stops when a round covers less than this fraction of the blocks of the empty-region map
+	double min_gain = 0.0005;
+};
+
+
+/*! Counters that describe what happened to the seed points of a layout */
+struct SeedStats {
+	//! The number of seed points produced by the curves of the layout
+	long generated = 0;
+	//! The number of seed points dropped before any curve was drawn from them (too close to another seed point, see `SeedOptions::deduplicate`)
+	long pre_rejected = 0;
+	//! The number of seed points from which a curve was drawn (accepted or not)
+	long traced = 0;
+	//! The number of seed points taken from the empty regions of the density grid (the roots of `lefer::auto_even_spaced_curves()` included)
+	long reseeded = 0;
 };
 
 
@@ -91,11 +439,45 @@ public:
 	bool is_empty();
 	void insert_coord(double x, double y);
 	void insert_point(Point p);
+	void clear();
+};
+
+
+/*! The seed points of a layout that are still waiting to be traced, across all of its curves
+ *
+ * With `SeedSchedule::fifo`, the seed points are stored in a ring buffer, and come out in the order
+ * they were pushed. With `SeedSchedule::centre_first`, they are stored in a binary heap, and the seed point
+ * that is closest to (`_centre_x`, `_centre_y`) comes out first.
+ */
+class SeedFrontier {
+public:
+	SeedSchedule _schedule;
+	//! The ring buffer of a FIFO frontier (its size is always a power of two)
+	std::vector<Point> _ring;
+	int _head;
+	int _size;
+	//! The binary heap of a prioritised frontier, with the squared distance of each seed point to the centre
+	std::vector<std::pair<double, Point>> _heap;
+	double _centre_x;
+	double _centre_y;
+
+public:
+	SeedFrontier(SeedSchedule schedule, double centre_x, double centre_y);
+	bool is_empty();
+	int size();
+	void push(Point p);
+	Point pop();
+	void clear();
+	void reset(SeedSchedule schedule, double centre_x, double centre_y);
 };
 
 
 
 SeedPointsQueue collect_seedpoints (Curve* curve, double d_sep);
+void collect_seedpoints (Curve* curve, double d_sep, SeedPointsQueue* queue);
+void collect_seedpoints (const CurveView& curve, double d_sep, SeedPointsQueue* queue);
+void collect_seedpoints (const CurveView& curve, double d_sep, SeedPointsQueue* queue, const SeedOptions& options);
+int deduplicate_seedpoints (SeedPointsQueue* queue, double d_sep);
 
 
 
@@ -106,7 +488,9 @@ Curve draw_curve(int curve_id,
 		 double step_length,
 		 double d_sep,
 		 FlowField* flow_field,
-		 DensityGrid* density_grid);
+		 DensityGrid* density_grid,
+		 SamplingMode sampling = SamplingMode::nearest,
+		 Integrator integrator = Integrator::euler);
 
 
 std::vector<Curve> even_spaced_curves(double x_start,
@@ -117,18 +501,642 @@ std::vector<Curve> even_spaced_curves(double x_start,
 				      double step_length,
 				      double d_sep,
 				      FlowField* flow_field,
-				      DensityGrid* density_grid);
+				      DensityGrid* density_grid,
+				      SamplingMode sampling = SamplingMode::nearest,
+				      Integrator integrator = Integrator::euler,
+				      const SeedOptions& seed_options = SeedOptions(),
+				      SeedStats* seed_stats = nullptr);
+
+
+CurveSet even_spaced_curve_set(double x_start,
+			       double y_start,
+			       int n_curves,
+			       int n_steps,
+			       int min_steps_allowed,
+			       double step_length,
+			       double d_sep,
+			       FlowField* flow_field,
+			       DensityGrid* density_grid,
+			       SamplingMode sampling = SamplingMode::nearest,
+			       Integrator integrator = Integrator::euler,
+			       const SeedOptions& seed_options = SeedOptions(),
+			       SeedStats* seed_stats = nullptr);
+
+
 
+std::vector<Curve> parallel_even_spaced_curves(double x_start,
+					       double y_start,
+					       int n_curves,
+					       int n_steps,
+					       int min_steps_allowed,
+					       double step_length,
+					       double d_sep,
+					       FlowField* flow_field,
+					       DensityGrid* density_grid,
+					       int n_threads,
+					       double tile_size = 0.0,
+					       SamplingMode sampling = SamplingMode::nearest,
+					       Integrator integrator = Integrator::euler);
 
 
-std::vector<Curve> non_overlapping_curves(std::vector<Point> starting_points,
+
+std::vector<Curve> speculative_even_spaced_curves(double x_start,
+						  double y_start,
+						  int n_curves,
+						  int n_steps,
+						  int min_steps_allowed,
+						  double step_length,
+						  double d_sep,
+						  FlowField* flow_field,
+						  DensityGrid* density_grid,
+						  int n_threads,
+						  int batch_size = 1024,
+						  SamplingMode sampling = SamplingMode::nearest,
+						  Integrator integrator = Integrator::euler);
+
+
+
+std::vector<Curve> auto_even_spaced_curves(int n_curves,
+					   int n_steps,
+					   int min_steps_allowed,
+					   double step_length,
+					   double d_sep,
+					   FlowField* flow_field,
+					   DensityGrid* density_grid,
+					   SamplingMode sampling = SamplingMode::nearest,
+					   Integrator integrator = Integrator::euler,
+					   const CoverageOptions& coverage_options = CoverageOptions(),
+					   const SeedOptions& seed_options = SeedOptions(),
+					   SeedStats* seed_stats = nullptr);
+
+
+CurveSet auto_even_spaced_curve_set(int n_curves,
+				    int n_steps,
+				    int min_steps_allowed,
+				    double step_length,
+				    double d_sep,
+				    FlowField* flow_field,
+				    DensityGrid* density_grid,
+				    SamplingMode sampling = SamplingMode::nearest,
+				    Integrator integrator = Integrator::euler,
+				    const CoverageOptions& coverage_options = CoverageOptions(),
+				    const SeedOptions& seed_options = SeedOptions(),
+				    SeedStats* seed_stats = nullptr);
+
+
+
+std::vector<Point> poisson_disc_points(int field_width, int field_height, double d_sep, uint64_t seed = 0, int n_attempts = 30);
+std::vector<Point> jittered_grid_points(int field_width, int field_height, double spacing, uint64_t seed = 0);
+
+
+std::vector<Curve> non_overlapping_curves(std::span<const Point> starting_points,
 				      int n_steps,
 				      int min_steps_allowed,
 				      double step_length,
 				      double d_sep,
 				      FlowField* flow_field,
-				      DensityGrid* density_grid);
+				      DensityGrid* density_grid,
+				      SamplingMode sampling = SamplingMode::nearest,
+				      Integrator integrator = Integrator::euler);
+
+
+CurveSet non_overlapping_curve_set(std::span<const Point> starting_points,
+				   int n_steps,
+				   int min_steps_allowed,
+				   double step_length,
+				   FlowField* flow_field,
+				   DensityGrid* density_grid,
+				   SamplingMode sampling = SamplingMode::nearest,
+				   Integrator integrator = Integrator::euler);
+
+
+
+/*! The description of one layout drawn by `lefer::even_spaced_curves_batch()`, i.e., the arguments of one call to `lefer::even_spaced_curves()` */
+struct CurveJob {
+	FlowField* flow_field;
+	double x_start;
+	double y_start;
+	int n_curves;
+	int n_steps;
+	int min_steps_allowed;
+	double step_length;
+	double d_sep;
+	SamplingMode sampling = SamplingMode::nearest;
+	Integrator integrator = Integrator::euler;
+	//! Which seed points are tried around each curve (see `lefer::SeedOptions`)
+	SeedOptions seed_options = SeedOptions();
+	//! If not null, receives the counters of the seed points of the job (give each job its own counters)
+	SeedStats* seed_stats = nullptr;
+};
+
+
+void even_spaced_curves_batch(const std::vector<CurveJob>& jobs,
+			      int n_threads,
+			      int cell_capacity,
+			      const std::function<void(int job_index, std::vector<Curve>&& curves)>& on_result);
+
+
+
+
+
+
+
+
+
+
+
+
+// Inline members =====================================================================
+//
+// These members are called at every step of every curve, so they are defined here,
+// to allow the compiler to inline them into the drawing loop.
+
+/** Transform a 2D index into a 1D index.
+*
+* @param x the x coordinate in a 2D grid.
+* @param y the y coordinate in a 2D grid.
+* @param grid_width the width of the 2D grid you are using.
+*/
+inline int _grid_index_as_1d(int x, int y, int grid_width) {
+	return x + grid_width * y;
+}
+
+inline int FlowField::get_field_width() {
+	return _field_width;
+}
+
+inline int FlowField::get_field_height() {
+	return _field_height;
+}
+
+inline int FlowField::get_flow_field_col(double x) {
+	return (int) x;
+}
+
+inline int FlowField::get_flow_field_row(double y) {
+	return (int) y;
+}
+
+inline bool FlowField::off_boundaries(double x, double y) {
+	return (
+	x <= 0 ||
+	y <= 0 ||
+	x >= _field_width ||
+	y >= _field_height
+	);
+}
+
+inline double FlowField::get_angle(double x, double y) {
+	int xi = get_flow_field_col(x);
+	int yi = get_flow_field_row(y);
+	return _angles[_grid_index_as_1d(xi, yi, _field_width)];
+}
+
+inline bool FlowField::has_directions() {
+	return !_directions.empty();
+}
+
+/** Get the unit vector that points in the direction of the field at (x, y).
+*
+* @param x the x coordinate.
+* @param y the y coordinate.
+*/
+inline Point FlowField::get_direction(double x, double y) {
+	int xi = get_flow_field_col(x);
+	int yi = get_flow_field_row(y);
+	size_t index = (size_t) _grid_index_as_1d(xi, yi, _field_width);
+	if (!_directions.empty()) {
+		return {_directions[index * 2], _directions[index * 2 + 1]};
+	}
+	double angle = _angles[index];
+	return {cos(angle), sin(angle)};
+}
+
+/** Get the unit vector of a cell of the field.
+*
+* Cells outside of the field are clamped to the closest cell at the border of the field.
+*
+* @param col the column of the cell.
+* @param row the row of the cell.
+*/
+inline Point FlowField::get_cell_direction(int col, int row) {
+	col = col < 0 ? 0 : (col >= _field_width ? _field_width - 1 : col);
+	row = row < 0 ? 0 : (row >= _field_height ? _field_height - 1 : row);
+	size_t index = (size_t) _grid_index_as_1d(col, row, _field_width);
+	if (!_directions.empty()) {
+		return {_directions[index * 2], _directions[index * 2 + 1]};
+	}
+	double angle = _angles[index];
+	return {cos(angle), sin(angle)};
+}
+
+inline void Curve::insert_step(double x_coord, double y_coord, int direction_id) {
+	_x.emplace_back(x_coord);
+	_y.emplace_back(y_coord);
+	_direction.emplace_back(direction_id);
+	_step_id.emplace_back(_steps_taken);
+	_steps_taken++;
+}
+
+inline int CurveView::steps_taken() const {
+	return (int) x.size();
+}
+
+inline int CurveView::seed_index() const {
+	return split - 1;
+}
+
+inline int CurveView::direction(int i) const {
+	return i < split ? 0 : 1;
+}
+
+
+
+
+
+
+
+
+
+// Compile-time policies ==============================================================
+//
+// The core of the drawing algorithm (`trace_curve()` and the template version of `draw_curve()`)
+// is parameterized by four policies, which are resolved at compile time:
+//
+// - Sampler: how the direction of the field is sampled at a point. It must provide
+//   `static Point sample(FlowField* flow_field, double x, double y)`;
+// - Integrator: how the curve advances at each step. It must provide `void reset(double step_length)`,
+//   which is called before each half of the curve, and `template <class Sampler> Point step(FlowField* flow_field, Point p, double sign, double step_length)`;
+// - Boundary: where the curve must stop. It must provide `bool off_boundaries(FlowField* flow_field, double x, double y)`;
+// - Proximity: the test that checks if a new point is far enough from the other curves. Any type
+//   with a `bool is_valid_next_step(double x, double y)` method works, such as `lefer::DensityGrid`.
+//
+// The non-template functions of the library (`draw_curve()`, `even_spaced_curves()`, etc.) pick one
+// of the instantiations below according to their `SamplingMode` and `Integrator` arguments.
+
+
+/*! Samples the direction of the cell that contains the point (see `SamplingMode::nearest`) */
+struct NearestSampler {
+	static inline Point sample(FlowField* flow_field, double x, double y) {
+		return flow_field->get_direction(x, y);
+	}
+};
+
+inline Point _normalized_direction(FlowField* flow_field, Point direction, double x, double y) {
+	double length = sqrt(direction.x * direction.x + direction.y * direction.y);
+	if (length < 1e-12) {
+		// The neighbouring directions cancel each other out, so we fall back to the cell direction
+		return flow_field->get_direction(x, y);
+	}
+	return {direction.x / length, direction.y / length};
+}
+
+/*! Interpolates the directions of the 4 closest cells (see `SamplingMode::bilinear`) */
+struct BilinearSampler {
+	static inline Point sample(FlowField* flow_field, double x, double y) {
+		double u = x - 0.5;
+		double v = y - 0.5;
+		int col = (int) u;
+		int row = (int) v;
+		// Truncation rounds towards zero, so we fix it for the negative values near the border
+		col = u < col ? col - 1 : col;
+		row = v < row ? row - 1 : row;
+		double fx = u - col;
+		double fy = v - row;
+
+		Point d00 = flow_field->get_cell_direction(col, row);
+		Point d10 = flow_field->get_cell_direction(col + 1, row);
+		Point d01 = flow_field->get_cell_direction(col, row + 1);
+		Point d11 = flow_field->get_cell_direction(col + 1, row + 1);
+		Point result = {
+			(1 - fy) * ((1 - fx) * d00.x + fx * d10.x) + fy * ((1 - fx) * d01.x + fx * d11.x),
+			(1 - fy) * ((1 - fx) * d00.y + fx * d10.y) + fy * ((1 - fx) * d01.y + fx * d11.y)
+		};
+		return _normalized_direction(flow_field, result, x, y);
+	}
+};
+
+/*! Interpolates the directions of the 16 closest cells with a Catmull-Rom spline (see `SamplingMode::bicubic`) */
+struct BicubicSampler {
+	static inline void weights(double t, double* w) {
+		double t2 = t * t;
+		double t3 = t2 * t;
+		w[0] = 0.5 * (-t3 + 2.0 * t2 - t);
+		w[1] = 0.5 * (3.0 * t3 - 5.0 * t2 + 2.0);
+		w[2] = 0.5 * (-3.0 * t3 + 4.0 * t2 + t);
+		w[3] = 0.5 * (t3 - t2);
+	}
+
+	static inline Point sample(FlowField* flow_field, double x, double y) {
+		double u = x - 0.5;
+		double v = y - 0.5;
+		int col = (int) u;
+		int row = (int) v;
+		col = u < col ? col - 1 : col;
+		row = v < row ? row - 1 : row;
+		double wx[4];
+		double wy[4];
+		weights(u - col, wx);
+		weights(v - row, wy);
+
+		Point result = {0.0, 0.0};
+		for (int j = 0; j < 4; j++) {
+			for (int i = 0; i < 4; i++) {
+				Point d = flow_field->get_cell_direction(col - 1 + i, row - 1 + j);
+				double w = wx[i] * wy[j];
+				result.x += w * d.x;
+				result.y += w * d.y;
+			}
+		}
+		return _normalized_direction(flow_field, result, x, y);
+	}
+};
+
+
+// Sample the direction at an intermediate stage of a step, which might fall outside of the field
+template <class Sampler>
+inline Point _stage_direction(FlowField* flow_field, double x, double y) {
+	double max_x = flow_field->get_field_width() - 1e-9;
+	double max_y = flow_field->get_field_height() - 1e-9;
+	x = x < 0 ? 0 : (x > max_x ? max_x : x);
+	y = y < 0 ? 0 : (y > max_y ? max_y : y);
+	return Sampler::sample(flow_field, x, y);
+}
+
+/*! Explicit Euler method (see `Integrator::euler`) */
+struct EulerIntegrator {
+	void reset(double) {}
+
+	template <class Sampler>
+	inline Point step(FlowField* flow_field, Point p, double sign, double step_length) {
+		double h = sign * step_length;
+		Point k1 = Sampler::sample(flow_field, p.x, p.y);
+		return {p.x + h * k1.x, p.y + h * k1.y};
+	}
+};
+
+/*! Midpoint method (see `Integrator::midpoint`) */
+struct MidpointIntegrator {
+	void reset(double) {}
+
+	template <class Sampler>
+	inline Point step(FlowField* flow_field, Point p, double sign, double step_length) {
+		double h = sign * step_length;
+		Point k1 = Sampler::sample(flow_field, p.x, p.y);
+		Point k2 = _stage_direction<Sampler>(flow_field, p.x + 0.5 * h * k1.x, p.y + 0.5 * h * k1.y);
+		return {p.x + h * k2.x, p.y + h * k2.y};
+	}
+};
+
+/*! Classic fourth order Runge-Kutta (see `Integrator::rk4`) */
+struct RK4Integrator {
+	void reset(double) {}
+
+	template <class Sampler>
+	inline Point step(FlowField* flow_field, Point p, double sign, double step_length) {
+		double h = sign * step_length;
+		Point k1 = Sampler::sample(flow_field, p.x, p.y);
+		Point k2 = _stage_direction<Sampler>(flow_field, p.x + 0.5 * h * k1.x, p.y + 0.5 * h * k1.y);
+		Point k3 = _stage_direction<Sampler>(flow_field, p.x + 0.5 * h * k2.x, p.y + 0.5 * h * k2.y);
+		Point k4 = _stage_direction<Sampler>(flow_field, p.x + h * k3.x, p.y + h * k3.y);
+		return {
+			p.x + (h / 6.0) * (k1.x + 2.0 * k2.x + 2.0 * k3.x + k4.x),
+			p.y + (h / 6.0) * (k1.y + 2.0 * k2.y + 2.0 * k3.y + k4.y)
+		};
+	}
+};
+
+/*! Runge-Kutta-Fehlberg 4(5) with adaptive step length (see `Integrator::rk45`)
+*
+* The difference between the 4th and 5th order solutions estimates the error of each step.
+* A step is retried with a shorter length while this error is above `relative_tolerance * step_length`,
+* and steps are never longer than `step_length`, nor shorter than `min_step_factor * step_length`.
+*/
+struct RK45Integrator {
+	//! The maximum local error of a step, relative to `step_length`
+	double relative_tolerance = 1e-3;
+	//! The shortest step (relative to `step_length`) that the integrator is allowed to take
+	double min_step_factor = 1.0 / 64.0;
+	//! The length of the next step
+	double current_step = 0.0;
+
+	void reset(double step_length) {
+		current_step = step_length;
+	}
+
+	template <class Sampler>
+	inline Point step(FlowField* flow_field, Point p, double sign, double step_length) {
+		double tolerance = relative_tolerance * step_length;
+		double min_step = min_step_factor * step_length;
+		double current = current_step;
+		Point k1 = Sampler::sample(flow_field, p.x, p.y);
+		while (1) {
+			double h = sign * current;
+			Point k2 = _stage_direction<Sampler>(flow_field, p.x + h * (1.0 / 4.0) * k1.x, p.y + h * (1.0 / 4.0) * k1.y);
+			Point k3 = _stage_direction<Sampler>(flow_field,
+				p.x + h * ((3.0 / 32.0) * k1.x + (9.0 / 32.0) * k2.x),
+				p.y + h * ((3.0 / 32.0) * k1.y + (9.0 / 32.0) * k2.y));
+			Point k4 = _stage_direction<Sampler>(flow_field,
+				p.x + h * ((1932.0 / 2197.0) * k1.x - (7200.0 / 2197.0) * k2.x + (7296.0 / 2197.0) * k3.x),
+				p.y + h * ((1932.0 / 2197.0) * k1.y - (7200.0 / 2197.0) * k2.y + (7296.0 / 2197.0) * k3.y));
+			Point k5 = _stage_direction<Sampler>(flow_field,
+				p.x + h * ((439.0 / 216.0) * k1.x - 8.0 * k2.x + (3680.0 / 513.0) * k3.x - (845.0 / 4104.0) * k4.x),
+				p.y + h * ((439.0 / 216.0) * k1.y - 8.0 * k2.y + (3680.0 / 513.0) * k3.y - (845.0 / 4104.0) * k4.y));
+			Point k6 = _stage_direction<Sampler>(flow_field,
+				p.x + h * (-(8.0 / 27.0) * k1.x + 2.0 * k2.x - (3544.0 / 2565.0) * k3.x + (1859.0 / 4104.0) * k4.x - (11.0 / 40.0) * k5.x),
+				p.y + h * (-(8.0 / 27.0) * k1.y + 2.0 * k2.y - (3544.0 / 2565.0) * k3.y + (1859.0 / 4104.0) * k4.y - (11.0 / 40.0) * k5.y));
+
+			Point order4 = {
+				p.x + h * ((25.0 / 216.0) * k1.x + (1408.0 / 2565.0) * k3.x + (2197.0 / 4104.0) * k4.x - (1.0 / 5.0) * k5.x),
+				p.y + h * ((25.0 / 216.0) * k1.y + (1408.0 / 2565.0) * k3.y + (2197.0 / 4104.0) * k4.y - (1.0 / 5.0) * k5.y)
+			};
+			Point order5 = {
+				p.x + h * ((16.0 / 135.0) * k1.x + (6656.0 / 12825.0) * k3.x + (28561.0 / 56430.0) * k4.x - (9.0 / 50.0) * k5.x + (2.0 / 55.0) * k6.x),
+				p.y + h * ((16.0 / 135.0) * k1.y + (6656.0 / 12825.0) * k3.y + (28561.0 / 56430.0) * k4.y - (9.0 / 50.0) * k5.y + (2.0 / 55.0) * k6.y)
+			};
+
+			double ex = order5.x - order4.x;
+			double ey = order5.y - order4.y;
+			double error = sqrt(ex * ex + ey * ey);
+			if (error <= tolerance || current <= min_step) {
+				// Accept the step, and try a longer step next time (but never longer than `step_length`)
+				double factor = error > 0 ? 0.9 * pow(tolerance / error, 0.2) : 4.0;
+				factor = factor > 4.0 ? 4.0 : factor;
+				double next = current * factor;
+				current_step = next > step_length ? step_length : (next < min_step ? min_step : next);
+				return order5;
+			}
+
+			// Reject the step, and retry with a shorter step
+			double factor = 0.9 * pow(tolerance / error, 0.25);
+			factor = factor < 0.2 ? 0.2 : factor;
+			current = current * factor;
+			current = current < min_step ? min_step : current;
+		}
+	}
+};
+
+/*! Stops the curves at the borders of the flow field */
+struct FieldBoundary {
+	inline bool off_boundaries(FlowField* flow_field, double x, double y) {
+		return flow_field->off_boundaries(x, y);
+	}
+};
+
+/*! Stops the curves at the borders of the flow field, or when they leave a rectangular region of the field */
+struct RegionBoundary {
+	double x_min;
+	double y_min;
+	double x_max;
+	double y_max;
+
+	inline bool off_boundaries(FlowField* flow_field, double x, double y) {
+		return (
+		flow_field->off_boundaries(x, y) ||
+		x < x_min ||
+		y < y_min ||
+		x >= x_max ||
+		y >= y_max
+		);
+	}
+};
+
+
+/** Trace one half of a curve, i.e., walk from a point in one direction of the flow field, and append the points to a `Curve` object.
+*
+* The starting point itself is not appended. The walk stops when the current point is off the boundaries, when the
+* next point is too close to other curves, or when `max_points` points were appended.
+*
+* @param curve the `Curve` object that receives the points.
+* @param start the point where the walk starts.
+* @param direction 1.0 to follow the flow field (left to right), -1.0 to walk against it (right to left).
+* @param max_points the maximum number of points appended.
+* @param step_length the length/distance taken in each step.
+* @param flow_field the flow field.
+* @param proximity the proximity test, usually, the density grid.
+* @param boundary the boundary rule.
+* @param integrator the integrator (it is reset before the first step).
+*
+* @return the number of points appended.
+*/
+template <class Sampler, class StepIntegrator, class Boundary, class Proximity>
+int trace_half_curve(Curve* curve,
+		     Point start,
+		     double direction,
+		     int max_points,
+		     double step_length,
+		     FlowField* flow_field,
+		     Proximity* proximity,
+		     Boundary& boundary,
+		     StepIntegrator& integrator) {
+
+	Point p = start;
+	int direction_id = direction > 0.0 ? 1 : 0;
+	integrator.reset(step_length);
+	int n = 0;
+	while (n < max_points) {
+		if (boundary.off_boundaries(flow_field, p.x, p.y)) {
+			break;
+		}
+
+		p = integrator.template step<Sampler>(flow_field, p, direction, step_length);
+		// The curve stores its points as `real_t`, so the rounded point is the one checked, otherwise (with
+		// single precision) the point stored could be closer to the other curves than the point checked.
+		// The integration goes on from the exact point, so the rounding errors do not add up along the curve.
+		real_t x = (real_t) p.x;
+		real_t y = (real_t) p.y;
+
+		if (!proximity->is_valid_next_step(x, y)) {
+			break;
+		}
+
+		curve->insert_step(x, y, direction_id);
+		n++;
+	}
+	return n;
+}
+
+/** Trace a curve through the flow field, and store its points into an existing `Curve` object.
+*
+* This is the core of `lefer::draw_curve()`, with the sampling method, the integrator, the boundary rule
+* and the proximity test resolved at compile time (see the description of each policy above).
+*
+* @param curve the `Curve` object that receives the points of the curve.
+* @param x_start the x coordinate of the starting point of the curve.
+* @param y_start the y coordinate of the starting point of the curve.
+* @param n_steps the number of steps used to draw your curve.
+* @param step_length the length/distance taken in each step.
+* @param flow_field the flow field.
+* @param proximity the proximity test, usually, the density grid.
+* @param boundary the boundary rule.
+* @param integrator the integrator.
+*/
+template <class Sampler, class StepIntegrator, class Boundary, class Proximity>
+void trace_curve(Curve* curve,
+		 double x_start,
+		 double y_start,
+		 int n_steps,
+		 double step_length,
+		 FlowField* flow_field,
+		 Proximity* proximity,
+		 Boundary boundary = Boundary(),
+		 StepIntegrator integrator = StepIntegrator()) {
+
+	curve->insert_step(x_start, y_start, 0);
+	Point start = {x_start, y_start};
+	int i = 1;
+	// Draw curve from right to left
+	i += trace_half_curve<Sampler, StepIntegrator, Boundary, Proximity>(
+		curve, start, -1.0, n_steps / 2 - i, step_length, flow_field, proximity, boundary, integrator
+	);
+
+	// The half drawn from right to left was stored from the starting point outwards,
+	// so it is reversed here, to keep the points of the curve in the order of the path
+	std::reverse(curve->_x.begin(), curve->_x.end());
+	std::reverse(curve->_y.begin(), curve->_y.end());
+	curve->_seed_index = curve->_steps_taken - 1;
+
+	// Draw curve from left to right
+	trace_half_curve<Sampler, StepIntegrator, Boundary, Proximity>(
+		curve, start, 1.0, n_steps - i, step_length, flow_field, proximity, boundary, integrator
+	);
+}
+
+/** Draw a curve in the flow field, with compile-time policies.
+*
+* Same as the non-template `lefer::draw_curve()`, but the sampling method, the integrator,
+* the boundary rule and the proximity test are template arguments. For example:
+*
+* `lefer::draw_curve<lefer::BilinearSampler, lefer::RK4Integrator, lefer::FieldBoundary, lefer::DensityGrid>(...)`.
+*/
+template <class Sampler, class StepIntegrator, class Boundary, class Proximity>
+Curve draw_curve(int curve_id,
+		 double x_start,
+		 double y_start,
+		 int n_steps,
+		 double step_length,
+		 FlowField* flow_field,
+		 Proximity* proximity,
+		 Boundary boundary = Boundary(),
+		 StepIntegrator integrator = StepIntegrator()) {
+
+	Curve curve = Curve(curve_id, n_steps);
+	trace_curve<Sampler, StepIntegrator, Boundary, Proximity>(
+		&curve,
+		x_start, y_start,
+		n_steps,
+		step_length,
+		flow_field,
+		proximity,
+		boundary,
+		integrator
+	);
+	return curve;
+}
 
 
 
+#ifdef LEFER_SINGLE_PRECISION
+} // inline namespace single_precision
+#endif
 } // namespace lefer
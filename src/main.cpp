@@ -1,13 +1,146 @@
 // C Math Library
 #include <math.h>
 
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define LEFER_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
 // C++ STD Libraries
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
 #include <vector>
 
 
 #include "lefer.hpp"
 
 namespace lefer {
+#ifdef LEFER_SINGLE_PRECISION
+inline namespace single_precision {
+#endif
+
+
+// Runtime dispatch of the compile-time policies ==========================================
+
+template <class Boundary, class Proximity>
+using CurveTracer = void (*)(Curve* curve,
+			     double x_start,
+			     double y_start,
+			     int n_steps,
+			     double step_length,
+			     FlowField* flow_field,
+			     Proximity* proximity,
+			     Boundary boundary);
+
+template <class Sampler, class StepIntegrator, class Boundary, class Proximity>
+static void _trace_curve(Curve* curve,
+			 double x_start,
+			 double y_start,
+			 int n_steps,
+			 double step_length,
+			 FlowField* flow_field,
+			 Proximity* proximity,
+			 Boundary boundary) {
+	trace_curve<Sampler, StepIntegrator, Boundary, Proximity>(
+		curve, x_start, y_start, n_steps, step_length, flow_field, proximity, boundary
+	);
+}
+
+template <class Boundary, class Proximity, class Sampler>
+static CurveTracer<Boundary, Proximity> _select_curve_tracer(Integrator integrator) {
+	switch (integrator) {
+	case Integrator::midpoint:
+		return _trace_curve<Sampler, MidpointIntegrator, Boundary, Proximity>;
+	case Integrator::rk4:
+		return _trace_curve<Sampler, RK4Integrator, Boundary, Proximity>;
+	case Integrator::rk45:
+		return _trace_curve<Sampler, RK45Integrator, Boundary, Proximity>;
+	default:
+		return _trace_curve<Sampler, EulerIntegrator, Boundary, Proximity>;
+	}
+}
+
+/** Select the instantiation of `lefer::trace_curve()` that matches the runtime settings.
+*
+* The selection is made once per call of the main APIs, so the drawing loop of each curve
+* runs fully specialized for the chosen sampling method and integrator.
+*/
+template <class Boundary, class Proximity>
+static CurveTracer<Boundary, Proximity> _select_curve_tracer(SamplingMode sampling, Integrator integrator) {
+	switch (sampling) {
+	case SamplingMode::bilinear:
+		return _select_curve_tracer<Boundary, Proximity, BilinearSampler>(integrator);
+	case SamplingMode::bicubic:
+		return _select_curve_tracer<Boundary, Proximity, BicubicSampler>(integrator);
+	default:
+		return _select_curve_tracer<Boundary, Proximity, NearestSampler>(integrator);
+	}
+}
+
+template <class Boundary, class Proximity>
+using HalfCurveTracer = int (*)(Curve* curve,
+				Point start,
+				double direction,
+				int max_points,
+				double step_length,
+				FlowField* flow_field,
+				Proximity* proximity,
+				Boundary boundary);
+
+template <class Sampler, class StepIntegrator, class Boundary, class Proximity>
+static int _trace_half_curve(Curve* curve,
+			     Point start,
+			     double direction,
+			     int max_points,
+			     double step_length,
+			     FlowField* flow_field,
+			     Proximity* proximity,
+			     Boundary boundary) {
+	StepIntegrator integrator = StepIntegrator();
+	return trace_half_curve<Sampler, StepIntegrator, Boundary, Proximity>(
+		curve, start, direction, max_points, step_length, flow_field, proximity, boundary, integrator
+	);
+}
+
+template <class Boundary, class Proximity, class Sampler>
+static HalfCurveTracer<Boundary, Proximity> _select_half_curve_tracer(Integrator integrator) {
+	switch (integrator) {
+	case Integrator::midpoint:
+		return _trace_half_curve<Sampler, MidpointIntegrator, Boundary, Proximity>;
+	case Integrator::rk4:
+		return _trace_half_curve<Sampler, RK4Integrator, Boundary, Proximity>;
+	case Integrator::rk45:
+		return _trace_half_curve<Sampler, RK45Integrator, Boundary, Proximity>;
+	default:
+		return _trace_half_curve<Sampler, EulerIntegrator, Boundary, Proximity>;
+	}
+}
+
+// Same as `_select_curve_tracer()`, for `lefer::trace_half_curve()`
+template <class Boundary, class Proximity>
+static HalfCurveTracer<Boundary, Proximity> _select_half_curve_tracer(SamplingMode sampling, Integrator integrator) {
+	switch (sampling) {
+	case SamplingMode::bilinear:
+		return _select_half_curve_tracer<Boundary, Proximity, BilinearSampler>(integrator);
+	case SamplingMode::bicubic:
+		return _select_half_curve_tracer<Boundary, Proximity, BicubicSampler>(integrator);
+	default:
+		return _select_half_curve_tracer<Boundary, Proximity, NearestSampler>(integrator);
+	}
+}
+
+
+
+
+
+
+
 
 
 // Main APIs of the library ================================================================
@@ -22,73 +155,212 @@ namespace lefer {
  *
  * For more details check: https://pedro-faria.netlify.app/posts/2024/2024-02-19-flow-even/en/
  *
+ * By default, each step follows the direction of the field at the current point (explicit Euler method).
+ * Higher order integrators (`lefer::Integrator`) follow the field much more accurately, so you can use
+ * longer steps (and therefore, fewer steps) for the same geometric error. With `lefer::Integrator::rk45`,
+ * `step_length` is the maximum length of a step, and the steps are shortened wherever the field bends too fast.
+ *
  *
  * @param curve_id the id of the curve you want to draw.
  * @param x_start the x coordinate of the starting point from which the function will start to draw your curve.
  * @param y_start the y coordinate of the starting point from which the function will start to draw your curve.
  * @param n_steps the number of steps used to draw your curve.
  * @param step_length the length/distance taken in each step.
-* @param d_sep the "separation distance", i.e., the amount of distance that each curve must be from neighbouring curves.
+* @param d_sep not used: the curve is kept apart from the other curves by the separation distance that `density_grid` was built with. Kept so that existing calls still compile.
 * @param flow_field a `lefer::FlowField` that contains the 2D grid of angle values that define your flow field.
 * @param density_grid the density grid to be used by the algorithm, i.e., a `lefer::DensityGrid` object.
+* @param sampling how the direction of the flow field is sampled at each step (see `lefer::FlowField::sample_direction()`).
+* @param integrator the numerical method used to advance the curve at each step (see `lefer::Integrator`).
 */
 Curve draw_curve(int curve_id,
 		 double x_start,
 		 double y_start,
 		 int n_steps,
 		 double step_length,
-		 double d_sep,
+		 [[maybe_unused]] double d_sep,
 		 FlowField* flow_field,
-		 DensityGrid* density_grid) {
+		 DensityGrid* density_grid,
+		 SamplingMode sampling,
+		 Integrator integrator) {
 
 	Curve curve = Curve(curve_id, n_steps);
-	curve.insert_step(x_start, y_start, 0);
-	double x = x_start;
-	double y = y_start;
-	int i = 1;
-	// Draw curve from right to left
-	while (i < (n_steps / 2)) {
-		if (flow_field->off_boundaries(x, y)) {
-			break;
-		}
+	CurveTracer<FieldBoundary, DensityGrid> trace = _select_curve_tracer<FieldBoundary, DensityGrid>(sampling, integrator);
+	trace(&curve, x_start, y_start, n_steps, step_length, flow_field, density_grid, FieldBoundary());
+	return curve;
+}
 
-		double angle = flow_field->get_angle(x, y);
-		double x_step = step_length * cos(angle);
-		double y_step = step_length * sin(angle);
-		x = x - x_step;
-		y = y - y_step;
 
-		if (!density_grid->is_valid_next_step(x, y)) {
-			break;
-		}
 
-		curve.insert_step(x, y, 0);
-		i++;
-	}
+// The buffers that a layout uses while it grows, and that the next layout can reuse (see `even_spaced_curves_batch()`)
+struct _LayoutScratch {
+	//! Every curve is traced into this same curve, and only the accepted curves are copied into the layout
+	Curve curve = Curve(0, 0);
+	//! The seed points of the last curve
+	SeedPointsQueue queue = SeedPointsQueue(0);
+	//! The seed points of all curves, waiting to be traced
+	SeedFrontier frontier = SeedFrontier(SeedSchedule::fifo, 0.0, 0.0);
+	std::vector<Point> empty_blocks;
+};
 
-	x = x_start;
-	y = y_start;
-	// Draw curve from left to right
-	while (i < n_steps) {
-		if (flow_field->off_boundaries(x, y)) {
-			break;
-		}
 
-		double angle = flow_field->get_angle(x, y);
-		double x_step = step_length * cos(angle);
-		double y_step = step_length * sin(angle);
-		x = x + x_step;
-		y = y + y_step;
+// The layout functions below fill either a `CurveSet` (the points of each accepted curve are copied into its buffers)
+// or a `std::vector<Curve>` (each accepted curve is moved into the vector, without copying its points)
+static int _layout_size(const CurveSet& curves) {
+	return curves.size();
+}
 
-		if (!density_grid->is_valid_next_step(x, y)) {
-			break;
+static int _layout_size(const std::vector<Curve>& curves) {
+	return (int) curves.size();
+}
+
+static CurveView _layout_curve(const CurveSet& curves, int i) {
+	return curves[i];
+}
+
+static CurveView _layout_curve(const std::vector<Curve>& curves, int i) {
+	const Curve& curve = curves[i];
+	int n = curve._steps_taken;
+	return {curve._curve_id, std::span<const real_t>(curve._x.data(), n), std::span<const real_t>(curve._y.data(), n), curve._seed_index + 1};
+}
+
+static void _layout_clear(CurveSet* curves, int n_curves) {
+	curves->clear();
+	curves->reserve(n_curves);
+}
+
+static void _layout_clear(std::vector<Curve>* curves, int n_curves) {
+	curves->clear();
+	curves->reserve(n_curves);
+}
+
+static void _layout_append(CurveSet* curves, Curve* curve) {
+	curves->append(curve);
+}
+
+// The buffers of `curve` go to the vector, and the next `reset()` of `curve` allocates new ones
+static void _layout_append(std::vector<Curve>* curves, Curve* curve) {
+	curves->emplace_back(std::move(*curve));
+}
+
+
+// Grows an evenly-spaced layout from the curves of `curves` that start at `first_curve`, i.e., draws new curves
+// from the seed points of these curves (and of the curves drawn from them), until there is no seed point
+// left, or `curves` has `n_curves` curves. Every curve is traced into `scratch->curve`, and the seed points of each
+// curve are collected into `scratch->queue`. `Layout` is a `CurveSet` or a `std::vector<Curve>`.
+template <class Layout>
+static void _grow_even_spaced_layout(Layout* curves,
+				     int first_curve,
+				     int n_curves,
+				     int n_steps,
+				     int min_steps_allowed,
+				     double step_length,
+				     double d_sep,
+				     FlowField* flow_field,
+				     DensityGrid* density_grid,
+				     CurveTracer<FieldBoundary, DensityGrid> trace,
+				     _LayoutScratch* scratch,
+				     const SeedOptions& seed_options,
+				     SeedStats* stats) {
+
+	Curve* curve = &scratch->curve;
+	SeedPointsQueue* queue = &scratch->queue;
+	SeedFrontier& frontier = scratch->frontier;
+	frontier.reset(seed_options.schedule, flow_field->get_field_width() / 2.0, flow_field->get_field_height() / 2.0);
+	std::vector<Point>& empty_blocks = scratch->empty_blocks;
+	// The seed points of the curves before `n_expanded` were already pushed into the frontier
+	int n_expanded = first_curve;
+	int n_curves_reseeded = -1;
+	while (_layout_size(*curves) < n_curves) {
+		// A FIFO frontier only takes the seed points of the next curve when it is empty, which keeps it small.
+		// A prioritised frontier needs the seed points of every curve to choose the best one.
+		bool expand = seed_options.schedule != SeedSchedule::fifo || frontier.is_empty();
+		if (expand && n_expanded < _layout_size(*curves)) {
+			collect_seedpoints(_layout_curve(*curves, n_expanded), d_sep, queue, seed_options);
+			stats->generated += queue->_points.size();
+			if (seed_options.deduplicate) {
+				stats->pre_rejected += deduplicate_seedpoints(queue, d_sep);
+			}
+			for (Point p: queue->_points) {
+				frontier.push(p);
+			}
+			n_expanded++;
+			continue;
+		}
+
+		if (frontier.is_empty()) {
+			// There is no more seed points to be analyzed. The empty regions of the grid are tried once, and then
+			// again only if any of their seed points added a curve (otherwise, the same regions would be found again)
+			if (!seed_options.reseed || _layout_size(*curves) == n_curves_reseeded) {
+				break;
+			}
+			n_curves_reseeded = _layout_size(*curves);
+			int block_size = seed_options.reseed_block_size > 0 ? seed_options.reseed_block_size : 3;
+			density_grid->find_empty_blocks(block_size, &empty_blocks);
+			stats->reseeded += empty_blocks.size();
+			for (Point p: empty_blocks) {
+				frontier.push(p);
+			}
+			continue;
 		}
 
-		curve.insert_step(x, y, 1);
-		i++;
+		Point p = frontier.pop();
+		// check if it is valid given the current state
+		if (density_grid->is_valid_next_step(p.x, p.y)) {
+			// if it is, draw the curve from it
+			stats->traced++;
+			curve->reset(_layout_size(*curves), n_steps);
+			trace(curve, p.x, p.y, n_steps, step_length, flow_field, density_grid, FieldBoundary());
+
+			if (curve->_steps_taken < min_steps_allowed) {
+				continue;
+			}
+
+			// insert this new curve into the density grid
+			density_grid->insert_curve_coords(curve);
+			_layout_append(curves, curve);
+		}
 	}
+}
 
-	return curve;
+
+
+// The body of `even_spaced_curves()` and `even_spaced_curve_set()`: draws the layout into `curves` (which is cleared first),
+// with the buffers of `scratch`. `Layout` is a `CurveSet` or a `std::vector<Curve>`.
+template <class Layout>
+static void _even_spaced_layout(Layout* curves,
+				_LayoutScratch* scratch,
+				double x_start,
+				double y_start,
+				int n_curves,
+				int n_steps,
+				int min_steps_allowed,
+				double step_length,
+				double d_sep,
+				FlowField* flow_field,
+				DensityGrid* density_grid,
+				SamplingMode sampling,
+				Integrator integrator,
+				const SeedOptions& seed_options,
+				SeedStats* seed_stats) {
+
+	_layout_clear(curves, n_curves);
+	CurveTracer<FieldBoundary, DensityGrid> trace = _select_curve_tracer<FieldBoundary, DensityGrid>(sampling, integrator);
+	Curve* curve = &scratch->curve;
+	curve->reset(0, n_steps);
+	trace(curve, x_start, y_start, n_steps, step_length, flow_field, density_grid, FieldBoundary());
+	density_grid->insert_curve_coords(curve);
+	_layout_append(curves, curve);
+
+	SeedStats stats;
+	scratch->queue.clear();
+	_grow_even_spaced_layout(
+		curves, 0, n_curves, n_steps, min_steps_allowed, step_length, d_sep, flow_field, density_grid,
+		trace, scratch, seed_options, &stats
+	);
+
+	if (seed_stats != nullptr) {
+		*seed_stats = stats;
+	}
 }
 
 
@@ -98,7 +370,12 @@ Curve draw_curve(int curve_id,
 * This function takes a starting point (`x_start` and `y_start`) in the flow field,
 * and draws a initial curve in the flow field. After that, the function starts a loop process,
 * to derivate `n_curves - 1` curves from this initial curve. All the curves that are drawn
-* into the field are derived from this initial curve.
+* into the field are derived from this initial curve (unless `seed_options.reseed` is set).
+*
+* The seed points of all curves wait in a single frontier (see `lefer::SeedFrontier`). By default, it is a FIFO,
+* so the layout grows breadth-first from the initial curve, and the seed points of a curve are only produced
+* once the seed points of the previous curves were all traced. If the frontier runs dry and `seed_options.reseed`
+* is set, new curves are started from the empty regions of the density grid (see `lefer::DensityGrid::find_empty_blocks()`).
 *
 * In other words, it is not guaranteed that this function will draw exactly `n_curves` curves
 * into the field, because, it might not have enough space for `n_curves` curves, considering your current settings. The function
@@ -115,6 +392,10 @@ Curve draw_curve(int curve_id,
 * @param d_sep the "separation distance", i.e., the amount of distance that each curve must be from neighbouring curves.
 * @param flow_field a `lefer::FlowField` that contains the 2D grid of angle values that define your flow field.
 * @param density_grid the density grid to be used by the algorithm, i.e., a `lefer::DensityGrid` object.
+* @param sampling how the direction of the flow field is sampled at each step (see `lefer::FlowField::sample_direction()`).
+* @param integrator the numerical method used to advance the curve at each step (see `lefer::Integrator`).
+* @param seed_options which seed points are tried around each curve (see `lefer::SeedOptions`).
+* @param seed_stats if not null, receives the counters of the seed points of the layout.
 */
 
 std::vector<Curve> even_spaced_curves(double x_start,
@@ -125,69 +406,274 @@ std::vector<Curve> even_spaced_curves(double x_start,
 				      double step_length,
 				      double d_sep,
 				      FlowField* flow_field,
-				      DensityGrid* density_grid) {
+				      DensityGrid* density_grid,
+				      SamplingMode sampling,
+				      Integrator integrator,
+				      const SeedOptions& seed_options,
+				      SeedStats* seed_stats) {
 
 	std::vector<Curve> curves;
-	curves.reserve(n_curves);
-	double x = x_start;
-	double y = y_start;
-	int curve_id = 0;
-	Curve curve = draw_curve(
-		curve_id,
-		x, y,
-		n_steps,
-		step_length,
-		d_sep,
-		flow_field,
-		density_grid
+	_LayoutScratch scratch;
+	_even_spaced_layout(
+		&curves, &scratch, x_start, y_start, n_curves, n_steps, min_steps_allowed, step_length, d_sep,
+		flow_field, density_grid, sampling, integrator, seed_options, seed_stats
+	);
+	return curves;
+}
+
+
+
+/** Draws multiple evenly-spaced and non-overlapping curves in the flow field, and returns them as a `lefer::CurveSet`.
+*
+* Same as `even_spaced_curves()`, but the points of all curves are stored in a single buffer
+* (see `lefer::CurveSet`), so drawing a curve does not allocate any memory of its own.
+*/
+CurveSet even_spaced_curve_set(double x_start,
+			       double y_start,
+			       int n_curves,
+			       int n_steps,
+			       int min_steps_allowed,
+			       double step_length,
+			       double d_sep,
+			       FlowField* flow_field,
+			       DensityGrid* density_grid,
+			       SamplingMode sampling,
+			       Integrator integrator,
+			       const SeedOptions& seed_options,
+			       SeedStats* seed_stats) {
+
+	CurveSet curves;
+	_LayoutScratch scratch;
+	_even_spaced_layout(
+		&curves, &scratch, x_start, y_start, n_curves, n_steps, min_steps_allowed, step_length, d_sep,
+		flow_field, density_grid, sampling, integrator, seed_options, seed_stats
 	);
+	return curves;
+}
 
-	curves.emplace_back(curve);
-	density_grid->insert_curve_coords(&curve);
 
-	while (curve_id < n_curves && curves.size() < n_curves) {
-		SeedPointsQueue queue = SeedPointsQueue(n_steps);
-		if (curve_id >= curves.size()) {
-			// There is no more curves to be analyzed in the queue
+
+/** Draws multiple evenly-spaced and non-overlapping curves in the flow field, choosing the starting points by itself.
+*
+* Instead of growing the whole layout from a single starting point, this function keeps a coarse map of the empty
+* regions of the density grid (see `lefer::EmptyRegionMap`), and starts root curves into them. At each round,
+* one root curve is started at the centre of each of the `coverage_options.roots_per_round` largest empty regions,
+* and the layout is grown from it, like in `even_spaced_curves()`. A block is never tried twice, so when a root curve is
+* rejected, the next round tries another block of the same region. The rounds stop when `n_curves` curves were drawn,
+* when `coverage_options.max_roots` root curves were tried, when every empty block was tried, or when a round adds
+* curves that cover less than `coverage_options.min_gain` of the blocks of the map.
+*
+* The density grid may already store other curves, in which case only the regions they left empty are filled.
+*
+* @param coverage_options how the root curves are started (see `lefer::CoverageOptions`).
+*
+* The other parameters are the same as in `even_spaced_curves()`.
+*/
+std::vector<Curve> auto_even_spaced_curves(int n_curves,
+					   int n_steps,
+					   int min_steps_allowed,
+					   double step_length,
+					   double d_sep,
+					   FlowField* flow_field,
+					   DensityGrid* density_grid,
+					   SamplingMode sampling,
+					   Integrator integrator,
+					   const CoverageOptions& coverage_options,
+					   const SeedOptions& seed_options,
+					   SeedStats* seed_stats) {
+
+	return auto_even_spaced_curve_set(
+		n_curves, n_steps, min_steps_allowed, step_length, d_sep, flow_field, density_grid,
+		sampling, integrator, coverage_options, seed_options, seed_stats
+	).to_curves();
+}
+
+
+/** Same as `auto_even_spaced_curves()`, but returns the curves as a `lefer::CurveSet`. */
+CurveSet auto_even_spaced_curve_set(int n_curves,
+				    int n_steps,
+				    int min_steps_allowed,
+				    double step_length,
+				    double d_sep,
+				    FlowField* flow_field,
+				    DensityGrid* density_grid,
+				    SamplingMode sampling,
+				    Integrator integrator,
+				    const CoverageOptions& coverage_options,
+				    const SeedOptions& seed_options,
+				    SeedStats* seed_stats) {
+
+	CurveSet curves;
+	curves.reserve(n_curves);
+	CurveTracer<FieldBoundary, DensityGrid> trace = _select_curve_tracer<FieldBoundary, DensityGrid>(sampling, integrator);
+	_LayoutScratch scratch;
+	Curve& curve = scratch.curve;
+	SeedStats stats;
+	EmptyRegionMap empty_regions = EmptyRegionMap(coverage_options.block_size);
+	empty_regions.update(density_grid);
+	std::vector<Point> roots;
+	int n_roots = 0;
+	int roots_per_round = coverage_options.roots_per_round > 0 ? coverage_options.roots_per_round : 1;
+	while (curves.size() < n_curves && n_roots < coverage_options.max_roots) {
+		long n_empty = empty_regions.n_empty();
+		int max_regions = std::min(roots_per_round, coverage_options.max_roots - n_roots);
+		if (empty_regions.largest_regions(max_regions, &roots) == 0) {
 			break;
 		}
-		queue = collect_seedpoints(&curves.at(curve_id), d_sep);
-		for (Point p: queue._points) {
+
+		int n_accepted = 0;
+		for (Point p: roots) {
 			if (curves.size() >= n_curves) {
 				break;
 			}
-			// check if it is valid given the current state
-			if (density_grid->is_valid_next_step(p.x, p.y)) {
-				// if it is, draw the curve from it
-				Curve curve = draw_curve(
-					curves.size(),
-					p.x, p.y,
-					n_steps,
-					step_length,
-					d_sep,
-					flow_field,
-					density_grid
-				);
-
-				if (curve._steps_taken < min_steps_allowed) {
-					continue;
-				}
-
-				curves.emplace_back(curve);
-				// insert this new curve into the density grid
-				density_grid->insert_curve_coords(&curve);
+			n_roots++;
+			stats.reseeded++;
+			empty_regions.mark_tried(p);
+			// The curves grown from the previous roots of this round may have reached this region
+			if (!density_grid->is_valid_next_step(p.x, p.y)) {
+				continue;
+			}
+			stats.traced++;
+			curve.reset(curves.size(), n_steps);
+			trace(&curve, p.x, p.y, n_steps, step_length, flow_field, density_grid, FieldBoundary());
+			if (curve._steps_taken < min_steps_allowed) {
+				continue;
 			}
+
+			n_accepted++;
+			density_grid->insert_curve_coords(&curve);
+			int root = curves.size();
+			curves.append(&curve);
+			_grow_even_spaced_layout(
+				&curves, root, n_curves, n_steps, min_steps_allowed, step_length, d_sep, flow_field, density_grid,
+				trace, &scratch, seed_options, &stats
+			);
+		}
+
+		empty_regions.update(density_grid);
+		// A round in which no root curve was accepted only moves on to the next blocks of the same regions
+		double gain = (double) (n_empty - empty_regions.n_empty()) / empty_regions.n_blocks();
+		if (n_accepted > 0 && gain < coverage_options.min_gain) {
+			break;
 		}
+	}
 
-		curve_id++;
+	if (seed_stats != nullptr) {
+		*seed_stats = stats;
 	}
+	return curves;
+}
 
 
 
-	return curves;
+
+// A splitmix64 generator, so that the same seed gives the same points with any compiler and standard library
+static inline uint64_t _random_next(uint64_t* state) {
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+// A uniform random number in [0, 1)
+static inline double _random_unit(uint64_t* state) {
+	return (_random_next(state) >> 11) * 0x1.0p-53;
+}
+
+
+/** Produces starting points with a Poisson-disc (or "blue noise") distribution.
+*
+* The points are produced with Bridson's algorithm: each new point is tried at a random distance between
+* `d_sep` and `2 * d_sep` from a point that is still "active", and a point stops being active after `n_attempts`
+* failed tries. No two points are closer than `d_sep` (minus the 1% tolerance of `lefer::DensityGrid`), and no
+* empty space is wider than about `2 * d_sep`. The distance checks use a `lefer::DensityGrid` with the same `d_sep`,
+* so every point is also a valid starting point for an empty density grid with the same geometry. The points
+* come out in the order they were produced, i.e., outwards from the first one.
+*
+* @param field_width the width of the flow field.
+* @param field_height the height of the flow field.
+* @param d_sep the minimum distance between two points (usually, the `d_sep` of the layout, or a multiple of it).
+*   If it is not positive, no point is produced.
+* @param seed the seed of the random generator (the same seed always gives the same points).
+* @param n_attempts the number of new points tried around each active point.
+*/
+std::vector<Point> poisson_disc_points(int field_width, int field_height, double d_sep, uint64_t seed, int n_attempts) {
+	// A NaN `d_sep` fails this test too
+	if (!(d_sep > 0.0)) {
+		return std::vector<Point>();
+	}
+	DensityGrid density_grid = DensityGrid(field_width, field_height, d_sep, 4);
+	std::vector<Point> points;
+	std::vector<int> active;
+	uint64_t state = seed;
+
+	for (int i = 0; i < n_attempts && points.empty(); i++) {
+		Point p = {_random_unit(&state) * field_width, _random_unit(&state) * field_height};
+		if (density_grid.is_valid_next_step(p.x, p.y)) {
+			density_grid.insert_coord(p.x, p.y);
+			points.push_back(p);
+			active.push_back(0);
+		}
+	}
+
+	while (!active.empty()) {
+		int k = (int) (_random_unit(&state) * active.size());
+		Point origin = points[active[k]];
+		bool found = false;
+		for (int i = 0; i < n_attempts; i++) {
+			// Uniform over the area of the annulus between `d_sep` and `2 * d_sep`
+			double r = d_sep * sqrt(1.0 + 3.0 * _random_unit(&state));
+			double angle = 2.0 * M_PI * _random_unit(&state);
+			Point p = {origin.x + r * cos(angle), origin.y + r * sin(angle)};
+			if (density_grid.is_valid_next_step(p.x, p.y)) {
+				density_grid.insert_coord(p.x, p.y);
+				active.push_back(points.size());
+				points.push_back(p);
+				found = true;
+				break;
+			}
+		}
+		if (!found) {
+			active[k] = active.back();
+			active.pop_back();
+		}
+	}
+
+	return points;
 }
 
 
+/** Produces starting points with a stratified (or "jittered") distribution.
+*
+* The field is split into square strata of `spacing` x `spacing` units, and one point is placed at a
+* random position inside each stratum. This is cheaper than `poisson_disc_points()`, but two points of
+* neighbouring strata can be arbitrarily close. The points come out in row-major order of their strata.
+*
+* @param field_width the width of the flow field.
+* @param field_height the height of the flow field.
+* @param spacing the size of each stratum (usually, a multiple of the `d_sep` of the layout).
+*   If it is not positive, no point is produced.
+* @param seed the seed of the random generator (the same seed always gives the same points).
+*/
+std::vector<Point> jittered_grid_points(int field_width, int field_height, double spacing, uint64_t seed) {
+	// A NaN `spacing` fails this test too
+	if (!(spacing > 0.0)) {
+		return std::vector<Point>();
+	}
+	int cols = (int) (field_width / spacing);
+	int rows = (int) (field_height / spacing);
+	std::vector<Point> points;
+	points.reserve((size_t) cols * rows);
+	uint64_t state = seed;
+	for (int row = 0; row < rows; row++) {
+		for (int col = 0; col < cols; col++) {
+			Point p = {(col + _random_unit(&state)) * spacing, (row + _random_unit(&state)) * spacing};
+			points.push_back(p);
+		}
+	}
+	return points;
+}
+
 
 
 /** Draws multiple non-overlapping curves in the flow field.
@@ -199,7 +685,9 @@ std::vector<Curve> even_spaced_curves(double x_start,
 *
 * This function takes a sequence of startings points (`starting_points`). For each starting point,
 * this function will attempt to draw a curve from it. So, in this function, you have total
-* control over which points exatly the curves starts from.
+* control over which points exatly the curves starts from. The starting points are only read,
+* so any contiguous sequence of them can be given (a `std::vector`, an array, or a part of them).
+* `poisson_disc_points()` and `jittered_grid_points()` produce well-distributed starting points.
 *
 * It is not guaranteed that this function will draw exactly `n_curves` curves
 * into the field, because, it might not have enough space for `n_curves` curves, considering your current settings. The function
@@ -211,46 +699,69 @@ std::vector<Curve> even_spaced_curves(double x_start,
 * @param n_steps the number of steps that each curve drawn into the field will have.
 * @param min_steps_allowed the minimum number of steps allowed for a curve. In other words, every curve that is drawn in the field must have at least `min_steps_allowed` steps.
 * @param step_length the length (or distance) taken in each step (usually, you want to set this variable between 1% and 0.1% of the flow field width.
-* @param d_sep the "separation distance", i.e., the amount of distance that each curve must be from neighbouring curves.
+* @param d_sep not used: the curves are kept apart by the separation distance that `density_grid` was built with. Kept so that existing calls still compile.
 * @param flow_field a `lefer::FlowField` that contains the 2D grid of angle values that define your flow field.
 * @param density_grid the density grid to be used by the algorithm, i.e., a `lefer::DensityGrid` object.
+* @param sampling how the direction of the flow field is sampled at each step (see `lefer::FlowField::sample_direction()`).
+* @param integrator the numerical method used to advance the curve at each step (see `lefer::Integrator`).
 */
 
 
-std::vector<Curve> non_overlapping_curves(std::vector<Point> starting_points,
+std::vector<Curve> non_overlapping_curves(std::span<const Point> starting_points,
 					  int n_steps,
 					  int min_steps_allowed,
 					  double step_length,
-					  double d_sep,
+					  [[maybe_unused]] double d_sep,
 					  FlowField* flow_field,
-					  DensityGrid* density_grid) {
+					  DensityGrid* density_grid,
+					  SamplingMode sampling,
+					  Integrator integrator) {
+
+	return non_overlapping_curve_set(
+		starting_points, n_steps, min_steps_allowed, step_length,
+		flow_field, density_grid, sampling, integrator
+	).to_curves();
+}
 
-	std::vector<Curve> curves;
+
+
+/** Draws multiple non-overlapping curves in the flow field, and returns them as a `lefer::CurveSet`.
+*
+* Same as `non_overlapping_curves()`, but the points of all curves are stored in a single buffer
+* (see `lefer::CurveSet`), so drawing a curve does not allocate any memory of its own. It takes no `d_sep`:
+* the curves are kept apart by the separation distance that `density_grid` was built with.
+*/
+CurveSet non_overlapping_curve_set(std::span<const Point> starting_points,
+				   int n_steps,
+				   int min_steps_allowed,
+				   double step_length,
+				   FlowField* flow_field,
+				   DensityGrid* density_grid,
+				   SamplingMode sampling,
+				   Integrator integrator) {
+
+	CurveSet curves;
 	curves.reserve(starting_points.size());
+	CurveTracer<FieldBoundary, DensityGrid> trace = _select_curve_tracer<FieldBoundary, DensityGrid>(sampling, integrator);
 	int curve_id = 0;
-	for (Point start_point: starting_points) {
+	// A rejected curve leaves its memory in `curve`, to be used by the next one (see `even_spaced_curve_set()`)
+	Curve curve = Curve(curve_id, n_steps);
+	for (const Point& start_point: starting_points) {
 		double x_start = start_point.x;
 		double y_start = start_point.y;
 		// Check if this starting point is valid given the current state
 		if (density_grid->is_valid_next_step(x_start, y_start)) {
 			// if it is, draw the curve from it
-			Curve curve = draw_curve(
-				curve_id,
-				x_start, y_start,
-				n_steps,
-				step_length,
-				d_sep,
-				flow_field,
-				density_grid
-			);
+			curve.reset(curve_id, n_steps);
+			trace(&curve, x_start, y_start, n_steps, step_length, flow_field, density_grid, FieldBoundary());
 
 			if (curve._steps_taken < min_steps_allowed) {
 				continue;
 			}
 
-			curves.emplace_back(curve);
 			// insert this new curve into the density grid
 			density_grid->insert_curve_coords(&curve);
+			curves.append(&curve);
 			curve_id++;
 		}
 	}
@@ -280,90 +791,397 @@ std::vector<Curve> non_overlapping_curves(std::vector<Point> starting_points,
 
 
 
-// Utilitaries =======================================================
+// Parallel APIs of the library ============================================================
 
-/** Calculate the distance between two points
-* 
-* @param x1 the x coordinate of point 1.
-* @param y1 the y coordinate of point 1.
-* @param x2 the x coordinate of point 2.
-* @param y2 the y coordinate of point 2.
-*/
-double distance (double x1, double y1, double x2, double y2) {
-	double s1 = pow(x2 - x1, 2.0);
-	double s2 = pow(y2 - y1, 2.0);
-	return sqrt(s1 + s2);
-}
 
-/** Transform a 2D index into a 1D index.
+/** Run `task(0)` up to `task(n_tasks - 1)` on `n_threads` threads.
 *
-* @param x the x coordinate in a 2D grid.
-* @param y the y coordinate in a 2D grid.
-* @param grid_width the width of the 2D grid you are using.
+* Each thread grabs the next task that was not started yet, until all tasks are done.
 */
-static int _grid_index_as_1d(int x, int y, int grid_width) {
-	return x + grid_width * y;
-}
-
-
-
-
-
+static void _parallel_for(int n_tasks, int n_threads, const std::function<void(int)>& task) {
+	n_threads = n_threads < n_tasks ? n_threads : n_tasks;
+	if (n_threads <= 1) {
+		for (int i = 0; i < n_tasks; i++) {
+			task(i);
+		}
+		return;
+	}
 
+	std::atomic<int> next_task(0);
+	auto worker = [&]() {
+		int i = next_task.fetch_add(1);
+		while (i < n_tasks) {
+			task(i);
+			i = next_task.fetch_add(1);
+		}
+	};
+	std::vector<std::thread> threads;
+	threads.reserve(n_threads - 1);
+	for (int t = 0; t < n_threads - 1; t++) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread: threads) {
+		thread.join();
+	}
+}
 
 
+// Proximity test used inside a tile: the point must be valid both in the shared density grid
+// (which is read-only while the tiles are running) and in the density grid local to the tile
+struct _TileProximity {
+	DensityGrid* shared_grid;
+	DensityGrid* tile_grid;
 
+	bool is_valid_next_step(double x, double y) {
+		return shared_grid->is_valid_next_step(x, y) && tile_grid->is_valid_next_step(x, y);
+	}
+};
+
+// Proximity test used to continue a curve inside a tile: same as `_TileProximity`, but the last points
+// of the curve (which are already in the shared density grid) do not block it
+struct _ContinuationProximity {
+	DensityGrid* shared_grid;
+	DensityGrid* tile_grid;
+	std::span<const Point> tail;
+
+	bool is_valid_next_step(double x, double y) {
+		if (!tile_grid->is_valid_next_step(x, y)) {
+			return 0;
+		}
+		return shared_grid->is_valid_next_step(x, y) || shared_grid->is_valid_next_step(x, y, tail);
+	}
+};
+
+// An end of a committed curve that was cut at the halo of the tile that drew it, and that is continued by the tile that contains it
+struct _CurveEnd {
+	//! The index of the curve in the layout
+	int curve;
+	//! -1.0 for the end drawn from right to left (the first point of the curve), 1.0 for the other end (the last point)
+	double direction;
+	//! The number of points that the curve can still take at this end
+	int max_points;
+	//! The points of the curve within `2 * d_sep` (along the path) of this end, the end itself first
+	std::vector<Point> tail;
+};
+
+// The points added to a curve by a tile, from one of its `_CurveEnd`s
+struct _CurveExtension {
+	_CurveEnd end;
+	//! The end of the curve, followed by the new points, going outwards
+	Curve piece;
+	//! Whether the new points were cut at the halo of the tile again
+	bool open;
+};
+
+// The state of a tile during a parallel run
+struct _Tile {
+	//! The seed points waiting to be processed in this tile
+	std::vector<Point> seeds;
+	//! The ends of curves waiting to be continued in this tile
+	std::vector<_CurveEnd> ends;
+	//! The curves accepted in this tile during the current phase
+	std::vector<Curve> curves;
+	//! For each curve of `curves`, whether its first (bit 0) and last (bit 1) points were cut at the halo of the tile
+	std::vector<int> open_ends;
+	//! The curves of other tiles continued by this tile during the current phase
+	std::vector<_CurveExtension> extensions;
+	//! The seed points produced in this tile that belong to other tiles
+	std::vector<Point> outbox;
+};
+
+// The number of points that `curve` can still take at the given end, in a layout of curves of `n_steps` steps
+// (like in `lefer::trace_curve()`, the half drawn from right to left has at most `n_steps / 2` points)
+static int _curve_end_budget(const Curve& curve, double direction, int n_steps) {
+	int budget = n_steps - curve._steps_taken;
+	if (direction < 0.0) {
+		int backward_budget = n_steps / 2 - (curve._seed_index + 1);
+		budget = backward_budget < budget ? backward_budget : budget;
+	}
+	return budget > 0 ? budget : 0;
+}
 
+static _CurveEnd _make_curve_end(const Curve& curve, int curve_index, double direction, int n_steps, double d_sep) {
+	_CurveEnd end = {curve_index, direction, _curve_end_budget(curve, direction, n_steps), {}};
+	int last = curve._steps_taken - 1;
+	int i = direction < 0.0 ? 0 : last;
+	int inwards = direction < 0.0 ? 1 : -1;
+	double arc = 0.0;
+	end.tail.push_back({curve._x[i], curve._y[i]});
+	while (arc <= 2.0 * d_sep && i + inwards >= 0 && i + inwards <= last) {
+		double dx = curve._x[i + inwards] - curve._x[i];
+		double dy = curve._y[i + inwards] - curve._y[i];
+		arc += sqrt(dx * dx + dy * dy);
+		i += inwards;
+		end.tail.push_back({curve._x[i], curve._y[i]});
+	}
+	return end;
+}
 
+// Adds the new points of `extension` to its curve (at most as many as the curve can still take), and to `density_grid`.
+// Returns the number of points added
+static int _splice_curve_extension(Curve* curve, const _CurveExtension& extension, int n_steps, DensityGrid* density_grid) {
+	int n_new = extension.piece._steps_taken - 1;
+	int budget = _curve_end_budget(*curve, extension.end.direction, n_steps);
+	n_new = n_new < budget ? n_new : budget;
+	if (extension.end.direction > 0.0) {
+		for (int i = 1; i <= n_new; i++) {
+			curve->insert_step(extension.piece._x[i], extension.piece._y[i], 1);
+		}
+	} else {
+		// The points of the half drawn from right to left are stored from the far end of the curve
+		for (int i = 1; i <= n_new; i++) {
+			curve->insert_step(extension.piece._x[i], extension.piece._y[i], 0);
+		}
+		int n = curve->_steps_taken;
+		std::rotate(curve->_x.begin(), curve->_x.begin() + (n - n_new), curve->_x.end());
+		std::rotate(curve->_y.begin(), curve->_y.begin() + (n - n_new), curve->_y.end());
+		std::rotate(curve->_direction.begin(), curve->_direction.begin() + (n - n_new), curve->_direction.end());
+		std::reverse(curve->_x.begin(), curve->_x.begin() + n_new);
+		std::reverse(curve->_y.begin(), curve->_y.begin() + n_new);
+		curve->_seed_index += n_new;
+	}
+	for (int i = 1; i <= n_new; i++) {
+		density_grid->insert_coord(extension.piece._x[i], extension.piece._y[i]);
+	}
+	return n_new;
+}
 
-// FlowField class =======================================================
 
-/** The constructor for FlowField class.
+/** Draws multiple evenly-spaced and non-overlapping curves in the flow field, using multiple threads.
 *
-* This constructor builds a wrapper object around a 2D grid of double values.
-* i.e. a 2D array of double values.
-* This 2D array of double values must be a heap-based (i.e. dinamically allocated) array.
+* This function produces the same kind of layout as `even_spaced_curves()`, but it spreads
+* the work over `n_threads` threads. The field is divided into square tiles of `tile_size` units,
+* and each tile keeps its own queue of seed points. The tiles are colored like a 2x2 checkerboard,
+* and the algorithm runs in phases, one color at a time, so two neighbouring tiles are never processed at the same time.
 *
-* Very important, this grid must be a square, meaning that, the height and width
-* of the field must be the same.
+* Inside a phase, each tile draws curves from its own seed points against a read-only view of `density_grid`
+* (plus a small density grid local to the tile). A curve is allowed to grow into a "halo" around its tile, which is thin
+* enough to guarantee that curves from different tiles in the same phase are always at least `d_sep` apart.
+* At the end of each phase, the new curves are inserted into `density_grid` (in tile order), and the seed points
+* that fall into other tiles (for example, seed points along the part of a curve that crosses into the halo)
+* are handed over to those tiles. The phases are repeated until no tile has seed points left, or until `n_curves`
+* curves are drawn.
 *
-* @param flowfield the 2D array of double values that defines the flow field.
-* @param field_width the width of the field.
+* A curve stops when it leaves the halo of its tile, but it is not finished there: its end is handed over to the
+* tile that contains it, which continues the curve in its own phase (ignoring the last points of the curve itself,
+* which are already in `density_grid`), and the new points are appended to the same curve when that tile commits.
+* A curve can cross any number of tiles this way, until it reaches `n_steps` steps, the borders of the field,
+* or another curve.
+*
+* So every curve respects the `d_sep` distance from every other curve in the whole field, just like in
+* `even_spaced_curves()`. The layout is not the same as the one of `even_spaced_curves()` (the curves
+* are drawn in a different order), but it has a similar number of curves. The output does not depend on `n_threads`.
 *
+* @param x_start the x coordinate of the starting point of the initial curve.
+* @param y_start the y coordinate of the starting point of the initial curve.
+* @param n_curves the number of curves that the function will attempt to draw from the initial curve.
+* @param n_steps the number of steps that each curve drawn into the field will have.
+* @param min_steps_allowed the minimum number of steps allowed for a curve. In other words, every curve that is drawn in the field must have at least `min_steps_allowed` steps.
+* @param step_length the length (or distance) taken in each step (usually, you want to set this variable between 1% and 0.1% of the flow field width.
+* @param d_sep the "separation distance", i.e., the amount of distance that each curve must be from neighbouring curves.
+* @param flow_field a `lefer::FlowField` that contains the 2D grid of angle values that define your flow field.
+* @param density_grid the density grid to be used by the algorithm, i.e., a `lefer::DensityGrid` object.
+* @param n_threads the number of threads to use.
+* @param tile_size the width of each tile (it must be at least `4 * d_sep + 2 * step_length`). Set it to zero to choose it automatically.
+* @param sampling how the direction of the flow field is sampled at each step (see `lefer::FlowField::sample_direction()`).
+* @param integrator the numerical method used to advance the curve at each step (see `lefer::Integrator`).
 */
-FlowField::FlowField(double** flow_field, int field_width) {
-	_flow_field = flow_field;
-	_field_width = field_width;
-}
-
-
-int FlowField::get_field_width() {
-	return _field_width;
-}
-
+std::vector<Curve> parallel_even_spaced_curves(double x_start,
+					       double y_start,
+					       int n_curves,
+					       int n_steps,
+					       int min_steps_allowed,
+					       double step_length,
+					       double d_sep,
+					       FlowField* flow_field,
+					       DensityGrid* density_grid,
+					       int n_threads,
+					       double tile_size,
+					       SamplingMode sampling,
+					       Integrator integrator) {
+
+	int field_width = flow_field->get_field_width();
+	int field_height = flow_field->get_field_height();
+	if (tile_size <= 0.0) {
+		// Long enough to hold a good part of a curve, but small enough to give work to all threads
+		double curve_length = n_steps * step_length / 2.0;
+		tile_size = curve_length > 8.0 * d_sep ? curve_length : 8.0 * d_sep;
+	}
+	double min_tile_size = 4.0 * d_sep + 2.0 * step_length;
+	tile_size = tile_size > min_tile_size ? tile_size : min_tile_size;
+	// Two tiles of the same color are one tile apart, so the halos of both tiles together must
+	// leave at least `d_sep` units of that tile untouched. A curve stops only after it takes
+	// a step outside of the halo, so its last point can be up to `step_length` beyond the halo.
+	double halo = (tile_size - 2.0 * d_sep) / 2.0 - step_length;
+	int tiles_x = (int) ceil(field_width / tile_size);
+	int tiles_y = (int) ceil(field_height / tile_size);
+	std::vector<_Tile> tiles(tiles_x * tiles_y);
+
+	auto route_seed = [&](Point p) {
+		if (flow_field->off_boundaries(p.x, p.y)) {
+			return;
+		}
+		int tx = (int) (p.x / tile_size);
+		int ty = (int) (p.y / tile_size);
+		tiles[_grid_index_as_1d(tx, ty, tiles_x)].seeds.push_back(p);
+	};
+	// The end of a curve is always in the field, and at most `halo + step_length` units away from the tile
+	// that drew it, so it lands in a neighbouring tile, which has another color
+	auto route_end = [&](const Curve& committed, int curve_index, double direction) {
+		_CurveEnd end = _make_curve_end(committed, curve_index, direction, n_steps, d_sep);
+		if (end.max_points == 0) {
+			return;
+		}
+		int tx = (int) (end.tail[0].x / tile_size);
+		int ty = (int) (end.tail[0].y / tile_size);
+		tiles[_grid_index_as_1d(tx, ty, tiles_x)].ends.emplace_back(std::move(end));
+	};
 
-int FlowField::get_flow_field_col(double x) {
-	return (int) x;
-}
+	std::vector<Curve> curves;
+	curves.reserve(n_curves);
+	CurveTracer<FieldBoundary, DensityGrid> trace = _select_curve_tracer<FieldBoundary, DensityGrid>(sampling, integrator);
+	CurveTracer<RegionBoundary, _TileProximity> trace_tile = _select_curve_tracer<RegionBoundary, _TileProximity>(sampling, integrator);
+	HalfCurveTracer<RegionBoundary, _ContinuationProximity> continue_tile = _select_half_curve_tracer<RegionBoundary, _ContinuationProximity>(sampling, integrator);
 
-int FlowField::get_flow_field_row(double y) {
-	return (int) y;
-}
+	Curve curve = Curve(0, n_steps);
+	trace(&curve, x_start, y_start, n_steps, step_length, flow_field, density_grid, FieldBoundary());
+	density_grid->insert_curve_coords(&curve);
+	for (Point p: collect_seedpoints(&curve, d_sep)._points) {
+		route_seed(p);
+	}
+	curves.emplace_back(std::move(curve));
+
+	bool pending_seeds = true;
+	while (pending_seeds && (int) curves.size() < n_curves) {
+		pending_seeds = false;
+		for (int color = 0; color < 4 && (int) curves.size() < n_curves; color++) {
+			std::vector<int> active_tiles;
+			for (int ty = color / 2; ty < tiles_y; ty += 2) {
+				for (int tx = color % 2; tx < tiles_x; tx += 2) {
+					int t = _grid_index_as_1d(tx, ty, tiles_x);
+					if (!tiles[t].seeds.empty() || !tiles[t].ends.empty()) {
+						active_tiles.push_back(t);
+					}
+				}
+			}
 
-bool FlowField::off_boundaries(double x, double y) {
-	return (
-	x <= 0 ||
-	y <= 0 ||
-	x >= _field_width ||
-	y >= _field_width
-	);
-}
+			int remaining = n_curves - (int) curves.size();
+			_parallel_for((int) active_tiles.size(), n_threads, [&](int task) {
+				int t = active_tiles[task];
+				_Tile& tile = tiles[t];
+				double x_min = (t % tiles_x) * tile_size;
+				double y_min = (t / tiles_x) * tile_size;
+				double x_max = x_min + tile_size;
+				double y_max = y_min + tile_size;
+				RegionBoundary boundary = {x_min - halo, y_min - halo, x_max + halo, y_max + halo};
+				DensityGrid tile_grid = DensityGrid(field_width, field_height, d_sep, 8, true);
+				_TileProximity proximity = {density_grid, &tile_grid};
+				Curve tile_curve = Curve(0, n_steps);
+				SeedPointsQueue queue = SeedPointsQueue(n_steps);
+				// A curve was cut at the halo when its last point is off the region of the tile, but still in the field
+				auto is_cut = [&](double x, double y) {
+					return !flow_field->off_boundaries(x, y) && boundary.off_boundaries(flow_field, x, y);
+				};
+				// The seed points produced inside the tile are processed in this same phase
+				auto keep_seeds = [&](Curve* piece) {
+					collect_seedpoints(piece, d_sep, &queue);
+					for (Point seed: queue._points) {
+						if (seed.x >= x_min && seed.y >= y_min && seed.x < x_max && seed.y < y_max) {
+							tile.seeds.push_back(seed);
+						} else {
+							tile.outbox.push_back(seed);
+						}
+					}
+				};
+
+				// The curves cut at the halo of the neighbouring tiles are continued first
+				for (_CurveEnd& end: tile.ends) {
+					int max_points = end.max_points;
+					_CurveExtension extension = {std::move(end), Curve(0, max_points + 1), false};
+					_ContinuationProximity continuation = {density_grid, &tile_grid, extension.end.tail};
+					Point start = extension.end.tail[0];
+					extension.piece.insert_step(start.x, start.y, extension.end.direction > 0.0 ? 1 : 0);
+					int n_new = continue_tile(
+						&extension.piece, start, extension.end.direction, extension.end.max_points, step_length, flow_field, &continuation, boundary
+					);
+					if (n_new == 0) {
+						continue;
+					}
+
+					int last = extension.piece._steps_taken - 1;
+					extension.open = n_new < extension.end.max_points && is_cut(extension.piece._x[last], extension.piece._y[last]);
+					tile_grid.insert_curve_coords(&extension.piece);
+					keep_seeds(&extension.piece);
+					tile.extensions.emplace_back(std::move(extension));
+				}
+				tile.ends.clear();
+
+				for (size_t s = 0; s < tile.seeds.size() && (int) tile.curves.size() < remaining; s++) {
+					Point p = tile.seeds[s];
+					if (!proximity.is_valid_next_step(p.x, p.y)) {
+						continue;
+					}
+					tile_curve.reset(0, n_steps);
+					trace_tile(&tile_curve, p.x, p.y, n_steps, step_length, flow_field, &proximity, boundary);
+					if (tile_curve._steps_taken < min_steps_allowed) {
+						continue;
+					}
+
+					int last = tile_curve._steps_taken - 1;
+					int open_ends = 0;
+					if (tile_curve._seed_index + 1 < n_steps / 2 && is_cut(tile_curve._x[0], tile_curve._y[0])) {
+						open_ends |= 1;
+					}
+					if (tile_curve._steps_taken < n_steps && is_cut(tile_curve._x[last], tile_curve._y[last])) {
+						open_ends |= 2;
+					}
+					tile_grid.insert_curve_coords(&tile_curve);
+					keep_seeds(&tile_curve);
+					tile.curves.emplace_back(std::move(tile_curve));
+					tile.open_ends.push_back(open_ends);
+				}
+				tile.seeds.clear();
+			});
+
+			// Commit the curves of this phase, and hand over the seed points and the curve ends that crossed into other tiles
+			for (int t: active_tiles) {
+				for (_CurveExtension& extension: tiles[t].extensions) {
+					Curve& committed = curves[extension.end.curve];
+					int n_new = _splice_curve_extension(&committed, extension, n_steps, density_grid);
+					if (extension.open && n_new == extension.piece._steps_taken - 1) {
+						route_end(committed, extension.end.curve, extension.end.direction);
+					}
+				}
+				tiles[t].extensions.clear();
+				for (size_t k = 0; k < tiles[t].curves.size() && (int) curves.size() < n_curves; k++) {
+					Curve& tile_curve = tiles[t].curves[k];
+					int curve_index = (int) curves.size();
+					tile_curve._curve_id = curve_index;
+					density_grid->insert_curve_coords(&tile_curve);
+					curves.emplace_back(std::move(tile_curve));
+					if (tiles[t].open_ends[k] & 1) {
+						route_end(curves[curve_index], curve_index, -1.0);
+					}
+					if (tiles[t].open_ends[k] & 2) {
+						route_end(curves[curve_index], curve_index, 1.0);
+					}
+				}
+				tiles[t].curves.clear();
+				tiles[t].open_ends.clear();
+				for (Point p: tiles[t].outbox) {
+					route_seed(p);
+				}
+				tiles[t].outbox.clear();
+			}
+		}
 
+		for (_Tile& tile: tiles) {
+			pending_seeds = pending_seeds || !tile.seeds.empty() || !tile.ends.empty();
+		}
+	}
 
-double FlowField::get_angle(double x, double y) {
-	int xi = get_flow_field_col(x);
-	int yi = get_flow_field_row(y);
-	return _flow_field[xi][yi];
+	return curves;
 }
 
 
@@ -374,39 +1192,1469 @@ double FlowField::get_angle(double x, double y) {
 
 
 
+/** Validate a candidate curve against the curves committed after its snapshot was taken.
+*
+* The candidate is truncated at the first point (going outwards from its starting point, in each direction)
+* that is too close to the curves in `committed_grid`. The points that survive are copied into `curve`.
+*
+* @return false if even the starting point of the candidate is too close to a committed curve.
+*/
+static bool _validate_candidate(Curve* candidate, DensityGrid* committed_grid, Curve* curve) {
+	int seed = candidate->_seed_index;
+	if (!committed_grid->is_valid_next_step(candidate->_x[seed], candidate->_y[seed])) {
+		return 0;
+	}
 
+	int first = seed;
+	while (first > 0 && committed_grid->is_valid_next_step(candidate->_x[first - 1], candidate->_y[first - 1])) {
+		first--;
+	}
+	int last = seed;
+	while (last < candidate->_steps_taken - 1 && committed_grid->is_valid_next_step(candidate->_x[last + 1], candidate->_y[last + 1])) {
+		last++;
+	}
+	for (int i = first; i <= last; i++) {
+		curve->insert_step(candidate->_x[i], candidate->_y[i], i <= seed ? 0 : 1);
+	}
+	curve->_seed_index = seed - first;
+	return 1;
+}
 
 
-// Curve class =======================================================
-
-
-/** The constructor for a Curve object
- *
- * This constructor returns a empty Curve object, that you can use
- * to store the coordinates and information about a specific curve you
+/** Draws multiple evenly-spaced and non-overlapping curves in the flow field, using speculative parallel execution.
+*
+* This function follows the same algorithm as `even_spaced_curves()`, but it draws many curves at once.
+* The seed points of the next parent curves are gathered in batches of (at least) `batch_size` points.
+* A seed point that is too close to a curve of the snapshot (see below) is dropped. A seed point that is too close
+* to a seed point taken earlier in the same batch would most likely be rejected in stage 2, so it is not traced:
+* it waits for the next batch instead, where it is checked again against the curves committed in the meantime.
+* Each batch is processed in two stages:
+*
+* 1. The worker threads draw a candidate curve from each seed point of the batch, against a read-only
+* snapshot of `density_grid` (i.e. the state of the grid at the start of the batch);
+* 2. The candidates are committed, one by one, in the order of their seed points. Each candidate is validated
+* against the curves committed earlier in the same batch (which were not in the snapshot). If the starting
+* point of the candidate is too close to one of these curves, the candidate is rejected. Otherwise, each half
+* of the candidate is truncated at its first point that is too close to one of these curves.
+*
+* Even so, the seed points of a parent curve lie next to each other, on two lines that run along the curve, so
+* the candidates of a batch often run next to each other too, and many of them are truncated or rejected in stage 2.
+* The layout has about as many curves as the one produced by `even_spaced_curves()`, but it is not the same:
+* a truncated curve does not reuse its unused steps to grow further in the other direction, and the seed points
+* are not tried in the same order.
+* The output depends only on `batch_size`, and not on `n_threads`.
+*
+* @param x_start the x coordinate of the starting point of the initial curve.
+* @param y_start the y coordinate of the starting point of the initial curve.
+* @param n_curves the number of curves that the function will attempt to draw from the initial curve.
+* @param n_steps the number of steps that each curve drawn into the field will have.
+* @param min_steps_allowed the minimum number of steps allowed for a curve. In other words, every curve that is drawn in the field must have at least `min_steps_allowed` steps.
+* @param step_length the length (or distance) taken in each step (usually, you want to set this variable between 1% and 0.1% of the flow field width.
+* @param d_sep the "separation distance", i.e., the amount of distance that each curve must be from neighbouring curves.
+* @param flow_field a `lefer::FlowField` that contains the 2D grid of angle values that define your flow field.
+* @param density_grid the density grid to be used by the algorithm, i.e., a `lefer::DensityGrid` object.
+* @param n_threads the number of threads to use.
+* @param batch_size the minimum number of seed points drawn speculatively in each batch (values below 1 are treated as 1).
+* @param sampling how the direction of the flow field is sampled at each step (see `lefer::FlowField::sample_direction()`).
+* @param integrator the numerical method used to advance the curve at each step (see `lefer::Integrator`).
+*/
+std::vector<Curve> speculative_even_spaced_curves(double x_start,
+						  double y_start,
+						  int n_curves,
+						  int n_steps,
+						  int min_steps_allowed,
+						  double step_length,
+						  double d_sep,
+						  FlowField* flow_field,
+						  DensityGrid* density_grid,
+						  int n_threads,
+						  int batch_size,
+						  SamplingMode sampling,
+						  Integrator integrator) {
+
+	int field_width = flow_field->get_field_width();
+	int field_height = flow_field->get_field_height();
+	// Each batch must take the seed points of at least one curve, or the layout would never move on
+	batch_size = batch_size > 1 ? batch_size : 1;
+	std::vector<Curve> curves;
+	curves.reserve(n_curves);
+	CurveTracer<FieldBoundary, DensityGrid> trace = _select_curve_tracer<FieldBoundary, DensityGrid>(sampling, integrator);
+
+	Curve curve = Curve(0, n_steps);
+	trace(&curve, x_start, y_start, n_steps, step_length, flow_field, density_grid, FieldBoundary());
+	density_grid->insert_curve_coords(&curve);
+	curves.emplace_back(std::move(curve));
+
+	int curve_id = 0;
+	std::vector<Point> seeds;
+	std::vector<Curve> candidates;
+	SeedPointsQueue queue = SeedPointsQueue(n_steps);
+	// The seed points taken in the current batch
+	DensityGrid seed_grid = DensityGrid(field_width, field_height, d_sep, 8, true);
+	// The curves committed in the current batch
+	DensityGrid committed_grid = DensityGrid(field_width, field_height, d_sep, 8, true);
+	// The seed points that were too close to a seed point of the batch, which wait for the next batch
+	std::vector<Point> deferred;
+	std::vector<Point> next_deferred;
+	auto take_seed = [&](Point p) {
+		if (!density_grid->is_valid_next_step(p.x, p.y)) {
+			return;
+		}
+		if (!seed_grid.is_valid_next_step(p.x, p.y)) {
+			next_deferred.push_back(p);
+			return;
+		}
+		seed_grid.insert_coord(p.x, p.y);
+		seeds.push_back(p);
+	};
+	while ((curve_id < (int) curves.size() || !deferred.empty()) && (int) curves.size() < n_curves) {
+		seeds.clear();
+		seed_grid.reset();
+		next_deferred.clear();
+		for (Point p: deferred) {
+			take_seed(p);
+		}
+		while (curve_id < (int) curves.size() && (int) seeds.size() < batch_size) {
+			collect_seedpoints(&curves[curve_id], d_sep, &queue);
+			for (Point p: queue._points) {
+				take_seed(p);
+			}
+			curve_id++;
+		}
+		std::swap(deferred, next_deferred);
+
+		// Stage 1: draw the candidates against the snapshot of the density grid
+		candidates.assign(seeds.size(), Curve(0, 0));
+		_parallel_for((int) seeds.size(), n_threads, [&](int i) {
+			Point p = seeds[i];
+			candidates[i] = Curve(0, n_steps);
+			trace(&candidates[i], p.x, p.y, n_steps, step_length, flow_field, density_grid, FieldBoundary());
+		});
+
+		// Stage 2: validate and commit the candidates in order
+		committed_grid.reset();
+		for (Curve& candidate: candidates) {
+			if ((int) curves.size() >= n_curves) {
+				break;
+			}
+			if (candidate._steps_taken < min_steps_allowed || candidate._steps_taken == 0) {
+				continue;
+			}
+
+			Curve accepted = Curve((int) curves.size(), candidate._steps_taken);
+			if (!_validate_candidate(&candidate, &committed_grid, &accepted)) {
+				continue;
+			}
+			if (accepted._steps_taken < min_steps_allowed) {
+				continue;
+			}
+
+			density_grid->insert_curve_coords(&accepted);
+			committed_grid.insert_curve_coords(&accepted);
+			curves.emplace_back(std::move(accepted));
+		}
+	}
+
+	return curves;
+}
+
+
+
+
+
+
+
+
+
+/** Run `task(0)` up to `task(n_tasks - 1)` on `n_threads` threads, using work-stealing.
+*
+* The tasks are dealt to the threads in round-robin order at the start. Each thread runs the tasks of
+* its own queue, from the back, and once its queue is empty, it steals tasks from the front of the queues
+* of the other threads. `task` also receives the index of the thread that runs it, so that each
+* thread can keep its own scratch memory between tasks.
+*/
+static void _work_stealing_for(int n_tasks, int n_threads, const std::function<void(int, int)>& task) {
+	n_threads = n_threads < n_tasks ? n_threads : n_tasks;
+	if (n_threads <= 1) {
+		for (int i = 0; i < n_tasks; i++) {
+			task(0, i);
+		}
+		return;
+	}
+
+	std::vector<std::deque<int>> queues(n_threads);
+	std::vector<std::mutex> queue_mutexes(n_threads);
+	for (int i = 0; i < n_tasks; i++) {
+		queues[i % n_threads].push_back(i);
+	}
+
+	auto next_task = [&](int thread_id, int* task_id) {
+		{
+			std::lock_guard<std::mutex> lock(queue_mutexes[thread_id]);
+			if (!queues[thread_id].empty()) {
+				*task_id = queues[thread_id].back();
+				queues[thread_id].pop_back();
+				return true;
+			}
+		}
+		for (int k = 1; k < n_threads; k++) {
+			int victim = (thread_id + k) % n_threads;
+			std::lock_guard<std::mutex> lock(queue_mutexes[victim]);
+			if (!queues[victim].empty()) {
+				*task_id = queues[victim].front();
+				queues[victim].pop_front();
+				return true;
+			}
+		}
+		// No task is ever added after the start, so empty queues mean that all tasks were taken
+		return false;
+	};
+	auto worker = [&](int thread_id) {
+		int task_id;
+		while (next_task(thread_id, &task_id)) {
+			task(thread_id, task_id);
+		}
+	};
+	std::vector<std::thread> threads;
+	threads.reserve(n_threads - 1);
+	for (int t = 1; t < n_threads; t++) {
+		threads.emplace_back(worker, t);
+	}
+	worker(0);
+	for (std::thread& thread: threads) {
+		thread.join();
+	}
+}
+
+
+// The density grid (and the geometry it was built for), and the buffers, that a thread of `even_spaced_curves_batch()`
+// reuses between jobs
+struct _BatchWorker {
+	std::unique_ptr<DensityGrid> density_grid;
+	int field_width = 0;
+	int field_height = 0;
+	double d_sep = 0.0;
+	_LayoutScratch scratch;
+};
+
+
+/** Draws many independent evenly-spaced layouts, using multiple threads.
+*
+* Each job in `jobs` is one call to `lefer::even_spaced_curves()`, and the jobs are spread over `n_threads`
+* threads with work-stealing, so a few expensive layouts do not leave the other threads idle. Each thread keeps
+* its density grid between jobs: if the next job has the same field size, the grid is reset (with the `d_sep`
+* of the job, see `lefer::DensityGrid::reset()`) instead of being allocated again. Each thread also keeps the
+* buffers of its layouts (the curve being traced, the seed points and the seed frontier), and clears them between
+* jobs. The accepted curves are moved into the result of the job, without copying their points.
+*
+* The curves of each job are handed to `on_result` as soon as the job is done, so the jobs finish
+* in any order, and `job_index` tells you which job the curves belong to. The calls to `on_result`
+* are serialized, so it does not need to be thread-safe, but it should return quickly, since the
+* thread that calls it does not start its next job until it returns.
+*
+* Each job must use its own flow field, or flow fields that are not modified during the batch. The `seed_stats`
+* of a job are written by the thread that runs it, before `on_result` is called for that job.
+*
+* @param jobs the layouts to draw.
+* @param n_threads the number of threads to use.
+* @param cell_capacity the number of points stored in each slab of the density grids (see `lefer::DensityGrid`).
+* @param on_result called once for each job, with the index of the job in `jobs` and its curves.
+*/
+void even_spaced_curves_batch(const std::vector<CurveJob>& jobs,
+			      int n_threads,
+			      int cell_capacity,
+			      const std::function<void(int job_index, std::vector<Curve>&& curves)>& on_result) {
+
+	int n_jobs = (int) jobs.size();
+	int n_workers = n_threads < n_jobs ? n_threads : n_jobs;
+	std::vector<_BatchWorker> workers(n_workers > 1 ? n_workers : 1);
+	std::mutex result_mutex;
+	_work_stealing_for(n_jobs, n_threads, [&](int thread_id, int job_index) {
+		const CurveJob& job = jobs[job_index];
+		_BatchWorker& worker = workers[thread_id];
+		int field_width = job.flow_field->get_field_width();
+		int field_height = job.flow_field->get_field_height();
+		if (worker.density_grid &&
+		    worker.field_width == field_width &&
+		    worker.field_height == field_height) {
+			if (worker.d_sep == job.d_sep) {
+				worker.density_grid->reset();
+			} else {
+				worker.density_grid->reset(job.d_sep);
+				worker.d_sep = job.d_sep;
+			}
+		} else {
+			worker.density_grid.reset(new DensityGrid(field_width, field_height, job.d_sep, cell_capacity));
+			worker.field_width = field_width;
+			worker.field_height = field_height;
+			worker.d_sep = job.d_sep;
+		}
+
+		std::vector<Curve> curves;
+		_even_spaced_layout(
+			&curves, &worker.scratch, job.x_start, job.y_start, job.n_curves, job.n_steps,
+			job.min_steps_allowed, job.step_length, job.d_sep, job.flow_field, worker.density_grid.get(),
+			job.sampling, job.integrator, job.seed_options, job.seed_stats
+		);
+		std::lock_guard<std::mutex> lock(result_mutex);
+		on_result(job_index, std::move(curves));
+	});
+}
+
+
+
+
+
+
+
+
+
+// Proximity kernels =================================================
+
+typedef bool (*ProximityKernel)(const real_t* xs, const real_t* ys, int n, double x, double y, double d_test2);
+
+static bool _any_point_within_scalar(const real_t* xs, const real_t* ys, int n, double x, double y, double d_test2) {
+	for (int i = 0; i < n; i++) {
+		double dx = xs[i] - x;
+		double dy = ys[i] - y;
+		if ((dx * dx + dy * dy) <= d_test2) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+#ifdef LEFER_X86_DISPATCH
+
+#ifdef LEFER_SINGLE_PRECISION
+
+// With single precision, the points are compared as floats, so each register holds twice as many points.
+// Each float operation of the squared distance rounds it by a relative error of at most 2^-24, i.e., the
+// squared distance can come out at most 4 * 2^-24 too small, so the threshold is raised by more than
+// that, and rounded up: two points closer than the test distance are never missed (the kernel may
+// only reject points that are a few millionths of a unit farther than it).
+static float _float_proximity_threshold(double d_test2) {
+	return nextafterf((float) (d_test2 * (1.0 + 0x1p-21)), INFINITY);
+}
+
+__attribute__((target("sse2")))
+static bool _any_point_within_sse2(const real_t* xs, const real_t* ys, int n, double x, double y, double d_test2) {
+	__m128 vx = _mm_set1_ps((float) x);
+	__m128 vy = _mm_set1_ps((float) y);
+	__m128 vd = _mm_set1_ps(_float_proximity_threshold(d_test2));
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128 dx1 = _mm_sub_ps(_mm_loadu_ps(xs + i), vx);
+		__m128 dy1 = _mm_sub_ps(_mm_loadu_ps(ys + i), vy);
+		__m128 dx2 = _mm_sub_ps(_mm_loadu_ps(xs + i + 4), vx);
+		__m128 dy2 = _mm_sub_ps(_mm_loadu_ps(ys + i + 4), vy);
+		__m128 d1 = _mm_add_ps(_mm_mul_ps(dx1, dx1), _mm_mul_ps(dy1, dy1));
+		__m128 d2 = _mm_add_ps(_mm_mul_ps(dx2, dx2), _mm_mul_ps(dy2, dy2));
+		__m128 hits = _mm_or_ps(_mm_cmple_ps(d1, vd), _mm_cmple_ps(d2, vd));
+		if (_mm_movemask_ps(hits) != 0) {
+			return 1;
+		}
+	}
+	return _any_point_within_scalar(xs + i, ys + i, n - i, x, y, d_test2);
+}
+
+__attribute__((target("avx2")))
+static bool _any_point_within_avx2(const real_t* xs, const real_t* ys, int n, double x, double y, double d_test2) {
+	if (n < 16) {
+		return _any_point_within_sse2(xs, ys, n, x, y, d_test2);
+	}
+	__m256 vx = _mm256_set1_ps((float) x);
+	__m256 vy = _mm256_set1_ps((float) y);
+	__m256 vd = _mm256_set1_ps(_float_proximity_threshold(d_test2));
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m256 dx1 = _mm256_sub_ps(_mm256_loadu_ps(xs + i), vx);
+		__m256 dy1 = _mm256_sub_ps(_mm256_loadu_ps(ys + i), vy);
+		__m256 dx2 = _mm256_sub_ps(_mm256_loadu_ps(xs + i + 8), vx);
+		__m256 dy2 = _mm256_sub_ps(_mm256_loadu_ps(ys + i + 8), vy);
+		__m256 d1 = _mm256_add_ps(_mm256_mul_ps(dx1, dx1), _mm256_mul_ps(dy1, dy1));
+		__m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx2, dx2), _mm256_mul_ps(dy2, dy2));
+		__m256 hits = _mm256_or_ps(_mm256_cmp_ps(d1, vd, _CMP_LE_OQ), _mm256_cmp_ps(d2, vd, _CMP_LE_OQ));
+		if (_mm256_movemask_ps(hits) != 0) {
+			return 1;
+		}
+	}
+	// The SSE2 kernel is not VEX-encoded, so the upper halves of the registers must be cleared before
+	// calling it (the compiler turns this call into a jump, and skips its own `vzeroupper`)
+	_mm256_zeroupper();
+	return _any_point_within_sse2(xs + i, ys + i, n - i, x, y, d_test2);
+}
+
+#else
+
+__attribute__((target("sse2")))
+static bool _any_point_within_sse2(const double* xs, const double* ys, int n, double x, double y, double d_test2) {
+	__m128d vx = _mm_set1_pd(x);
+	__m128d vy = _mm_set1_pd(y);
+	__m128d vd = _mm_set1_pd(d_test2);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128d dx1 = _mm_sub_pd(_mm_loadu_pd(xs + i), vx);
+		__m128d dy1 = _mm_sub_pd(_mm_loadu_pd(ys + i), vy);
+		__m128d dx2 = _mm_sub_pd(_mm_loadu_pd(xs + i + 2), vx);
+		__m128d dy2 = _mm_sub_pd(_mm_loadu_pd(ys + i + 2), vy);
+		__m128d d1 = _mm_add_pd(_mm_mul_pd(dx1, dx1), _mm_mul_pd(dy1, dy1));
+		__m128d d2 = _mm_add_pd(_mm_mul_pd(dx2, dx2), _mm_mul_pd(dy2, dy2));
+		__m128d hits = _mm_or_pd(_mm_cmple_pd(d1, vd), _mm_cmple_pd(d2, vd));
+		if (_mm_movemask_pd(hits) != 0) {
+			return 1;
+		}
+	}
+	return _any_point_within_scalar(xs + i, ys + i, n - i, x, y, d_test2);
+}
+
+__attribute__((target("avx2")))
+static bool _any_point_within_avx2(const double* xs, const double* ys, int n, double x, double y, double d_test2) {
+	if (n < 8) {
+		return _any_point_within_sse2(xs, ys, n, x, y, d_test2);
+	}
+	__m256d vx = _mm256_set1_pd(x);
+	__m256d vy = _mm256_set1_pd(y);
+	__m256d vd = _mm256_set1_pd(d_test2);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256d dx1 = _mm256_sub_pd(_mm256_loadu_pd(xs + i), vx);
+		__m256d dy1 = _mm256_sub_pd(_mm256_loadu_pd(ys + i), vy);
+		__m256d dx2 = _mm256_sub_pd(_mm256_loadu_pd(xs + i + 4), vx);
+		__m256d dy2 = _mm256_sub_pd(_mm256_loadu_pd(ys + i + 4), vy);
+		__m256d d1 = _mm256_add_pd(_mm256_mul_pd(dx1, dx1), _mm256_mul_pd(dy1, dy1));
+		__m256d d2 = _mm256_add_pd(_mm256_mul_pd(dx2, dx2), _mm256_mul_pd(dy2, dy2));
+		__m256d hits = _mm256_or_pd(_mm256_cmp_pd(d1, vd, _CMP_LE_OQ), _mm256_cmp_pd(d2, vd, _CMP_LE_OQ));
+		if (_mm256_movemask_pd(hits) != 0) {
+			return 1;
+		}
+	}
+	// The SSE2 kernel is not VEX-encoded, so the upper halves of the registers must be cleared before
+	// calling it (the compiler turns this call into a jump, and skips its own `vzeroupper`)
+	_mm256_zeroupper();
+	return _any_point_within_sse2(xs + i, ys + i, n - i, x, y, d_test2);
+}
+
+#endif
+
+#endif
+
+static ProximityKernel _select_proximity_kernel() {
+#ifdef LEFER_X86_DISPATCH
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return _any_point_within_avx2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return _any_point_within_sse2;
+	}
+#endif
+	return _any_point_within_scalar;
+}
+
+// The kernel is selected on the first call, so it is also ready when the library is called from the
+// static initializers of other translation units
+static ProximityKernel _proximity_kernel() {
+	static const ProximityKernel kernel = _select_proximity_kernel();
+	return kernel;
+}
+
+
+
+
+
+
+
+
+
+// Utilitaries =======================================================
+
+/** Calculate the distance between two points
+* 
+* @param x1 the x coordinate of point 1.
+* @param y1 the y coordinate of point 1.
+* @param x2 the x coordinate of point 2.
+* @param y2 the y coordinate of point 2.
+*/
+double distance (double x1, double y1, double x2, double y2) {
+	double s1 = pow(x2 - x1, 2.0);
+	double s2 = pow(y2 - y1, 2.0);
+	return sqrt(s1 + s2);
+}
+
+/** Check if any of the given points is close to the point (x, y).
+*
+* This is the proximity test used by `lefer::DensityGrid::is_valid_next_step()`, and therefore, the hottest
+* loop of the library. It compares squared distances against `d_test2` (so no `sqrt()` is needed),
+* and returns as soon as the first close point is found.
+*
+* On x86 processors, the points are tested 4 or 8 at a time (8 or 16 with `LEFER_SINGLE_PRECISION`) with SSE2 or AVX2 instructions. The
+* best version available in the current CPU is selected at runtime, and a scalar version is used on
+* any other platform.
+*
+* @param xs the x coordinates of the points to be tested.
+* @param ys the y coordinates of the points to be tested.
+* @param n the number of points to be tested.
+* @param x the x coordinate of the reference point.
+* @param y the y coordinate of the reference point.
+* @param d_test2 the squared distance below which (inclusive) a point is considered close.
+*/
+bool any_point_within (const real_t* xs, const real_t* ys, int n, double x, double y, double d_test2) {
+	return _proximity_kernel()(xs, ys, n, x, y, d_test2);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+// FlowField class =======================================================
+
+/** The constructor for FlowField class.
+*
+* This constructor builds a `FlowField` object from a 2D grid of double values.
+* i.e. a 2D array of double values, where `flow_field[x][y]` is the angle at the column `x` and row `y`.
+* This 2D array of double values must be a heap-based (i.e. dinamically allocated) array.
+*
+* Very important, this grid must be a square, meaning that, the height and width
+* of the field must be the same. If this is not your case, use the constructor that
+* also takes the height of the field.
+*
+* The values of the grid are copied into a contiguous buffer owned by the object,
+* so you can free your 2D array after the object is built.
+*
+* @param flowfield the 2D array of double values that defines the flow field.
+* @param field_width the width of the field.
+*
+*/
+FlowField::FlowField(double** flow_field, int field_width)
+	: FlowField(flow_field, field_width, field_width) {}
+
+/** The constructor for FlowField class, for fields that are not square.
+*
+* Same as the constructor above, but for a field with `field_width` columns
+* (i.e. `flow_field[0]` up to `flow_field[field_width - 1]`) and `field_height` rows.
+*
+* @param flowfield the 2D array of double values that defines the flow field.
+* @param field_width the width of the field.
+* @param field_height the height of the field.
+*/
+FlowField::FlowField(double** flow_field, int field_width, int field_height) {
+	_field_width = field_width;
+	_field_height = field_height;
+	_owned_angles = std::vector<real_t>((size_t) field_width * field_height);
+	for (int y = 0; y < field_height; y++) {
+		for (int x = 0; x < field_width; x++) {
+			_owned_angles[_grid_index_as_1d(x, y, field_width)] = flow_field[x][y];
+		}
+	}
+	_angles = _owned_angles.data();
+}
+
+/** Build a FlowField that is a view over a contiguous buffer owned by the caller.
+*
+* The buffer must store the angles in row-major order, i.e., the angle at the column `x` and row `y`
+* must be at `flow_field[x + field_width * y]`. Nothing is copied, so the buffer
+* must stay alive (and must not be moved) while the object is in use.
+*
+* @param flowfield the contiguous buffer of `field_width * field_height` angles.
+* @param field_width the width of the field.
+* @param field_height the height of the field.
+*/
+FlowField::FlowField(const real_t* flow_field, int field_width, int field_height) {
+	_field_width = field_width;
+	_field_height = field_height;
+	_angles = flow_field;
+}
+
+/** Build a FlowField that owns a contiguous buffer of angles.
+*
+* The buffer must store the angles in row-major order, i.e., the angle at the column `x` and row `y`
+* must be at `flow_field[x + field_width * y]`. Use `std::move()` to hand over your buffer without copying it.
+*
+* @param flowfield the contiguous buffer of `field_width * field_height` angles.
+* @param field_width the width of the field.
+* @param field_height the height of the field.
+*/
+FlowField::FlowField(std::vector<real_t> flow_field, int field_width, int field_height) {
+	_field_width = field_width;
+	_field_height = field_height;
+	_owned_angles = std::move(flow_field);
+	_angles = _owned_angles.data();
+}
+
+FlowField::FlowField(const FlowField& other) {
+	_field_width = other._field_width;
+	_field_height = other._field_height;
+	_owned_angles = other._owned_angles;
+	_angles = _owned_angles.empty() ? other._angles : _owned_angles.data();
+	_directions = other._directions;
+}
+
+FlowField& FlowField::operator=(const FlowField& other) {
+	if (this != &other) {
+		_field_width = other._field_width;
+		_field_height = other._field_height;
+		_owned_angles = other._owned_angles;
+		_angles = _owned_angles.empty() ? other._angles : _owned_angles.data();
+		_directions = other._directions;
+	}
+	return *this;
+}
+
+
+/** Precompute the direction of each cell in the field.
+*
+* The angle of the field only changes from one cell to another, so, instead of calling
+* `cos()` and `sin()` at every step of every curve, you can call this method once,
+* to compute and store the unit vector of each cell. After that, `get_direction()`
+* (and therefore, all the functions that draw curves) use these stored vectors.
+*
+* This doubles the memory used by the field. If you change the angles of the field
+* after calling this method, you must call it again.
+*/
+void FlowField::precompute_directions() {
+	size_t n_cells = (size_t) _field_width * _field_height;
+	_directions = std::vector<real_t>(n_cells * 2);
+	for (size_t i = 0; i < n_cells; i++) {
+		_directions[i * 2] = cos(_angles[i]);
+		_directions[i * 2 + 1] = sin(_angles[i]);
+	}
+}
+
+/** Sample the direction of the field at (x, y).
+*
+* With `SamplingMode::nearest`, this is the same as `get_direction()`, i.e., the direction
+* of the cell that contains the point. With `SamplingMode::bilinear` and `SamplingMode::bicubic`,
+* the direction vectors of the closest cells (the value of each cell is placed at its center)
+* are interpolated, and the result is normalized back into a unit vector. Interpolating the
+* vectors (instead of the angles) avoids the jump between -π and π.
+*
+* Interpolated sampling produces smooth curves even with a coarse flow field, at the cost of
+* reading 4 (bilinear) or 16 (bicubic) cells per sample. It is much cheaper if you call
+* `precompute_directions()` first. Points near the border of the field use the cells at the border.
+*
+* @param x the x coordinate.
+* @param y the y coordinate.
+* @param sampling the sampling method.
+*/
+Point FlowField::sample_direction(double x, double y, SamplingMode sampling) {
+	if (sampling == SamplingMode::bilinear) {
+		return BilinearSampler::sample(this, x, y);
+	}
+	if (sampling == SamplingMode::bicubic) {
+		return BicubicSampler::sample(this, x, y);
+	}
+	return NearestSampler::sample(this, x, y);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+// Curve class =======================================================
+
+
+/** The constructor for a Curve object
+ *
+ * This constructor returns a empty Curve object, that you can use
+ * to store the coordinates and information about a specific curve you
  * want to drawn into the field.
  *
  * @param id the id you want to give to this Curve object.
  * @param n_steps the number of steps you will use to draw this curve.
 */
-Curve::Curve(int id, int n_steps) {
-	_curve_id = id;
-	_steps_taken = 0;
-	_x.reserve(n_steps);
-	_y.reserve(n_steps);
-	_direction.reserve(n_steps);
-	_step_id.reserve(n_steps);
+Curve::Curve(int id, int n_steps) {
+	_curve_id = id;
+	_steps_taken = 0;
+	_seed_index = 0;
+	_x.reserve(n_steps);
+	_y.reserve(n_steps);
+	_direction.reserve(n_steps);
+	_step_id.reserve(n_steps);
+}
+
+/** Empty the curve, so that it can be drawn again, but keep the memory it already allocated.
+ *
+ * @param id the new id of the curve.
+ * @param n_steps the number of steps that the curve must be able to store without allocating.
+ */
+void Curve::reset(int id, int n_steps) {
+	_curve_id = id;
+	_steps_taken = 0;
+	_seed_index = 0;
+	_x.clear();
+	_y.clear();
+	_direction.clear();
+	_step_id.clear();
+	_x.reserve(n_steps);
+	_y.reserve(n_steps);
+	_direction.reserve(n_steps);
+	_step_id.reserve(n_steps);
+}
+
+
+
+// CurveSet class =======================================================
+
+
+/** The constructor for an empty CurveSet object */
+CurveSet::CurveSet() {
+	_offsets.push_back(0);
+}
+
+/** The number of curves in the set */
+int CurveSet::size() const {
+	return (int) _splits.size();
+}
+
+/** The number of points of all curves in the set */
+size_t CurveSet::n_points() const {
+	return _x.size();
+}
+
+/** Get a view over the points of the curve `i` of the set.
+ *
+ * The view points into the buffers of the set, so it is valid only until the next
+ * curve is appended to the set.
+ */
+CurveView CurveSet::get_curve(int i) const {
+	size_t begin = _offsets[i];
+	size_t n = _offsets[i + 1] - begin;
+	return {i, std::span<const real_t>(_x.data() + begin, n), std::span<const real_t>(_y.data() + begin, n), _splits[i]};
+}
+
+CurveView CurveSet::operator[](int i) const {
+	return get_curve(i);
+}
+
+/** Reserve memory for `n_curves` curves (the buffers of points still grow on demand). */
+void CurveSet::reserve(int n_curves) {
+	_offsets.reserve(n_curves + 1);
+	_splits.reserve(n_curves);
+}
+
+/** Copy the points of a curve to the end of the set.
+ *
+ * The id of the curve in the set is its index, so the `_curve_id` of `curve` is not used.
+ */
+void CurveSet::append(const Curve* curve) {
+	int steps_taken = curve->_steps_taken;
+	_x.insert(_x.end(), curve->_x.begin(), curve->_x.begin() + steps_taken);
+	_y.insert(_y.end(), curve->_y.begin(), curve->_y.begin() + steps_taken);
+	_offsets.push_back(_x.size());
+	_splits.push_back(curve->_seed_index + 1);
+}
+
+/** Remove all curves from the set, but keep the memory it already allocated. */
+void CurveSet::clear() {
+	_x.clear();
+	_y.clear();
+	_offsets.resize(1);
+	_splits.clear();
+}
+
+/** Convert the set into one `lefer::Curve` object per curve. */
+std::vector<Curve> CurveSet::to_curves() const {
+	std::vector<Curve> curves;
+	curves.reserve(size());
+	for (int i = 0; i < size(); i++) {
+		CurveView view = get_curve(i);
+		Curve& curve = curves.emplace_back(i, view.steps_taken());
+		for (int j = 0; j < view.steps_taken(); j++) {
+			curve.insert_step(view.x[j], view.y[j], view.direction(j));
+		}
+		curve._seed_index = view.seed_index();
+	}
+	return curves;
+}
+
+
+
+
+
+
+
+
+
+
+
+// DensityGrid class ============================================================================
+
+
+/** The constructor for DensityGrid class
+ *
+ * The Jobard and Lefer algortihm works around a "supporting" 2D grid, called of "density grid".
+ * Each cell (or coordinate) in this density grid is responsible for keeping tracking of
+ * curves that are already drawn into that specific area of the flow field.
+ *
+ * All points inserted into the grid are stored in a single contiguous buffer, which is
+ * divided into "slabs" of `cell_capacity` entries. A cell does not own any memory until
+ * the first point is inserted into it, and at that moment, a new slab is taken from the end of the buffer.
+ * If a cell fills up its slab, another slab is taken from the buffer and chained to the cell,
+ * so no point is ever lost, no matter how crowded the cell gets.
+ *
+ * This means that the memory used by the grid scales with the number of points that
+ * you actually insert into it, instead of the total number of cells in the grid. Also, the points
+ * of each cell are stored next to each other, which makes the search for neighbouring points
+ * in `is_valid_next_step()` much more cache friendly.
+ *
+ * Each cell also keeps a small summary of its content: a bit in a packed occupancy bitmap,
+ * and the bounding box of its points. This way, `is_valid_next_step()` can skip empty cells,
+ * and cells whose points are all too far away, without looking at any of their points.
+ *
+ * Because cells grow on demand, you usually want a small `cell_capacity`. If you want to tune it
+ * for your own fields, check the `overflow_slabs` and `max_cell_size` counters returned by `get_stats()`.
+ *
+ * A dense grid (the default) still allocates a few bytes for every cell in the grid. For very large
+ * flow fields (or very small `d_sep` values), you can build a sparse grid instead, by setting `sparse` to true.
+ * A sparse grid finds its cells through a hash table, so it does not allocate anything up front, and its
+ * memory scales only with the area of the field that the curves actually cover. The price is a hash
+ * lookup for each cell visited by `insert_coord()` and `is_valid_next_step()`.
+ *
+ * @param flow_field_width the width of the flow field.
+ * @param flow_field_height the height of the flow field.
+* @param d_sep the "separation distance", i.e., the amount of distance that each curve must be from neighbouring curves.
+* @param cell_capacity the number of points stored in each slab of the density grid.
+* @param sparse whether to build a sparse grid (true) or a dense grid (false).
+*/
+DensityGrid::DensityGrid(int flow_field_width, int flow_field_height, double d_sep, int cell_capacity, bool sparse) {
+	_flow_field_width = flow_field_width;
+	_flow_field_height = flow_field_height;
+	_sparse = sparse;
+	_set_geometry(d_sep);
+	_cell_capacity = cell_capacity > 0 ? cell_capacity : 1;
+	_n_slabs = 0;
+	_hash_used = 0;
+	if (_sparse) {
+		_hash_keys = std::vector<int64_t>(1024, -1);
+		_hash_records = std::vector<int>(1024, -1);
+	} else {
+		_cell_record = std::vector<int>(_n_elements, -1);
+		_occupancy = std::vector<uint64_t>((_n_elements + 63) / 64, 0);
+	}
+	_stats = {0, 0, 0, 0, 0};
+}
+
+void DensityGrid::_set_geometry(double d_sep) {
+	int grid_width = (int)(_flow_field_width / d_sep);
+	int grid_height = (int)(_flow_field_height / d_sep);
+	_d_sep = d_sep;
+	// Subtracting a very small amount from D_TEST, just to account for the lost of float precision
+	// that happens during the calculations in `is_valid_next_step()`, specially in the distance calc
+	_d_test = _d_sep - (0.01 * _d_sep);
+	_d_test2 = _d_test * _d_test;
+	_width = grid_width;
+	_height = grid_height;
+	// A sparse grid is meant for fields with more positions than an `int` can count, so it never needs this number
+	_n_elements = _sparse ? 0 : (size_t) grid_width * grid_height;
+}
+
+int DensityGrid::get_density_col (double x) {
+	double c = (x / _d_sep);
+	return (int) c;
+}
+
+int DensityGrid::get_density_row (double y) {
+	double r = (y / _d_sep);
+	return (int) r;
+}
+
+int DensityGrid::get_density_index (double x, double y) {
+	int col = get_density_col(x);
+	int row = get_density_row(y);
+	return col + _width * row;
+}
+
+int DensityGrid::get_density_index (int col, int row) {
+	return col + _width * row;
+}
+
+bool DensityGrid::off_boundaries(double x, double y) {
+	int c = get_density_col(x);
+	int r = get_density_row(y);
+	return (
+	c <= 0 ||
+	r <= 0 ||
+	c >= _width ||
+	r >= _height
+	);
+}
+
+bool DensityGrid::is_sparse() {
+	return _sparse;
+}
+
+int DensityGrid::get_width() {
+	return _width;
+}
+
+int DensityGrid::get_height() {
+	return _height;
+}
+
+double DensityGrid::get_d_sep() {
+	return _d_sep;
+}
+
+/** Check if a cell of the density grid stores at least one point.
+ *
+ * @param col the column of the cell in the density grid.
+ * @param row the row of the cell in the density grid.
+ */
+bool DensityGrid::is_cell_occupied(int col, int row) {
+	return _find_cell(col, row) != -1;
+}
+
+/** Marks the blocks of the grid that store at least one point.
+*
+* The grid is split into blocks of `block_size` x `block_size` cells, and `occupied` is set to a packed
+* bitmap with one bit per block, in row-major order (with `get_width() / block_size` blocks per row). Only the
+* cells that store points are visited, so the cost does not depend on the size of the field (which matters for
+* a sparse grid), but the bitmap covers the whole field, even on a sparse grid. The cells of the incomplete blocks at the
+* right and bottom borders are ignored. A `block_size` below 1 is treated as 3.
+*/
+void DensityGrid::mark_occupied_blocks(int block_size, std::vector<uint64_t>* occupied) {
+	block_size = block_size > 0 ? block_size : 3;
+	int cols = _width / block_size;
+	int rows = _height / block_size;
+	size_t n_blocks = (size_t) cols * rows;
+	occupied->assign((n_blocks + 63) / 64, 0);
+	for (int cell: _record_cell) {
+		int col;
+		int row;
+		if (_sparse) {
+			int64_t key = _hash_keys[cell];
+			col = (int) (uint32_t) key;
+			row = (int) (key >> 32);
+		} else {
+			col = cell % _width;
+			row = cell / _width;
+		}
+		int block_col = col / block_size;
+		int block_row = row / block_size;
+		if (block_col < cols && block_row < rows) {
+			size_t block = block_col + (size_t) cols * block_row;
+			(*occupied)[block >> 6] |= ((uint64_t) 1) << (block & 63);
+		}
+	}
+}
+
+/** Finds the empty regions of the grid.
+*
+* The grid is scanned in blocks of `block_size` x `block_size` cells (see `mark_occupied_blocks()`). For each
+* block that stores no point at all, the centre of the block is added to `centres` (which is cleared first).
+* With an odd `block_size` of 3 or more, the centre of an empty block is always a valid next step. A `block_size`
+* below 1 is treated as 3.
+*
+* @returns the number of empty blocks found.
+*/
+int DensityGrid::find_empty_blocks(int block_size, std::vector<Point>* centres) {
+	block_size = block_size > 0 ? block_size : 3;
+	centres->clear();
+	std::vector<uint64_t> occupied;
+	mark_occupied_blocks(block_size, &occupied);
+	int cols = _width / block_size;
+	int rows = _height / block_size;
+	for (int block_row = 0; block_row < rows; block_row++) {
+		for (int block_col = 0; block_col < cols; block_col++) {
+			size_t block = block_col + (size_t) cols * block_row;
+			if ((occupied[block >> 6] >> (block & 63)) & 1) {
+				continue;
+			}
+			int col = block_col * block_size;
+			int row = block_row * block_size;
+			Point p = {(col + block_size / 2.0) * _d_sep, (row + block_size / 2.0) * _d_sep};
+			centres->emplace_back(p);
+		}
+	}
+	return centres->size();
+}
+
+/** Creates an empty map, with blocks of `block_size` x `block_size` cells (a `block_size` below 1 is treated as 3). */
+EmptyRegionMap::EmptyRegionMap(int block_size) {
+	_block_size = block_size > 0 ? block_size : 3;
+	_cols = 0;
+	_rows = 0;
+	_d_sep = 0.0;
+	_n_empty = 0;
+}
+
+/** Rebuilds the map from the points currently stored in `density_grid`.
+*
+* The empty blocks are grouped into regions with a flood fill, and the depth of each block (its
+* distance to the nearest block that is not empty) is computed with a two-pass chessboard distance transform.
+* Only the cells that store points are visited to find the empty blocks (see `lefer::DensityGrid::mark_occupied_blocks()`).
+*/
+void EmptyRegionMap::update(DensityGrid* density_grid) {
+	_cols = density_grid->get_width() / _block_size;
+	_rows = density_grid->get_height() / _block_size;
+	_d_sep = density_grid->get_d_sep();
+	// The blocks are indexed with `size_t`, since a sparse grid can cover a field with more blocks than an `int` can count
+	size_t n = (size_t) _cols * _rows;
+	if (_tried.size() != n) {
+		_tried.assign(n, 0);
+	}
+	_region.assign(n, -1);
+	_region_size.clear();
+	_region_centre.clear();
+	_depth.assign(n, 0);
+
+	// The blocks are the same as the ones of `find_empty_blocks()`. Empty blocks are marked with -2 until they get a region
+	density_grid->mark_occupied_blocks(_block_size, &_occupied);
+	_n_empty = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (!((_occupied[i >> 6] >> (i & 63)) & 1)) {
+			_region[i] = -2;
+			_n_empty++;
+		}
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		if (_region[i] == -1) {
+			continue;
+		}
+		int col = i % _cols;
+		int row = i / _cols;
+		int up = (row > 0 && col > 0 && col < _cols - 1) ? std::min(_depth[i - _cols - 1], std::min(_depth[i - _cols], _depth[i - _cols + 1])) : 0;
+		int left = col > 0 ? _depth[i - 1] : 0;
+		_depth[i] = std::min(up, left) + 1;
+	}
+	for (size_t i = n; i-- > 0;) {
+		if (_region[i] == -1) {
+			continue;
+		}
+		int col = i % _cols;
+		int row = i / _cols;
+		int down = (row < _rows - 1 && col > 0 && col < _cols - 1) ? std::min(_depth[i + _cols - 1], std::min(_depth[i + _cols], _depth[i + _cols + 1])) : 0;
+		int right = col < _cols - 1 ? _depth[i + 1] : 0;
+		_depth[i] = std::min(_depth[i], std::min(down, right) + 1);
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		if (_region[i] != -2) {
+			continue;
+		}
+		int region = _region_size.size();
+		_region_size.push_back(0);
+		_region_centre.push_back(-1);
+		_region[i] = region;
+		_stack.push_back(i);
+		while (!_stack.empty()) {
+			size_t b = _stack.back();
+			_stack.pop_back();
+			_region_size[region]++;
+			if (!_tried[b] && (_region_centre[region] == -1 || _depth[b] > _depth[_region_centre[region]])) {
+				_region_centre[region] = (long) b;
+			}
+			int col = b % _cols;
+			int row = b / _cols;
+			// `n` marks a missing neighbour
+			size_t neighbours[4] = {
+				col > 0 ? b - 1 : n,
+				col < _cols - 1 ? b + 1 : n,
+				row > 0 ? b - _cols : n,
+				row < _rows - 1 ? b + _cols : n
+			};
+			for (size_t next: neighbours) {
+				if (next != n && _region[next] == -2) {
+					_region[next] = region;
+					_stack.push_back(next);
+				}
+			}
+		}
+	}
+}
+
+long EmptyRegionMap::n_blocks() {
+	return (long) _cols * _rows;
+}
+
+long EmptyRegionMap::n_empty() {
+	return _n_empty;
+}
+
+int EmptyRegionMap::n_regions() {
+	return _region_size.size();
+}
+
+/** The fraction of the blocks of the map that store at least one point. */
+double EmptyRegionMap::coverage() {
+	if (n_blocks() == 0) {
+		return 1.0;
+	}
+	return 1.0 - (double) _n_empty / n_blocks();
+}
+
+/** Finds the largest empty regions of the map.
+*
+* The centre of each of the (at most) `max_regions` largest regions is added to `centres` (which is cleared first),
+* from the largest region to the smallest one. The centre of a region is the centre of its block that is the farthest
+* from any point of the grid, skipping the blocks that were marked with `mark_tried()` (a region without any other
+* block is skipped).
+*
+* @returns the number of centres added.
+*/
+int EmptyRegionMap::largest_regions(int max_regions, std::vector<Point>* centres) {
+	centres->clear();
+	std::vector<int> regions;
+	for (int i = 0; i < (int) _region_size.size(); i++) {
+		if (_region_centre[i] != -1) {
+			regions.push_back(i);
+		}
+	}
+	int n = std::min(max_regions, (int) regions.size());
+	std::partial_sort(regions.begin(), regions.begin() + n, regions.end(), [this](int a, int b) {
+		return _region_size[a] != _region_size[b] ? _region_size[a] > _region_size[b] : a < b;
+	});
+	for (int i = 0; i < n; i++) {
+		long block = _region_centre[regions[i]];
+		int col = block % _cols;
+		int row = block / _cols;
+		Point p = {(col * _block_size + _block_size / 2.0) * _d_sep, (row * _block_size + _block_size / 2.0) * _d_sep};
+		centres->emplace_back(p);
+	}
+	return n;
+}
+
+/** Marks the block that contains `p` as tried, so that `largest_regions()` does not return it again. */
+void EmptyRegionMap::mark_tried(Point p) {
+	int col = (int) (p.x / _d_sep) / _block_size;
+	int row = (int) (p.y / _d_sep) / _block_size;
+	if (col >= 0 && col < _cols && row >= 0 && row < _rows) {
+		_tried[col + (size_t) _cols * row] = 1;
+	}
+}
+
+static inline int64_t _sparse_cell_key(int col, int row) {
+	return ((int64_t) row << 32) | (uint32_t) col;
+}
+
+static inline size_t _sparse_cell_hash(int64_t key, size_t mask) {
+	return (size_t)(((uint64_t) key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+}
+
+int DensityGrid::_find_cell(int col, int row) {
+	if (!_sparse) {
+		int density_index = get_density_index(col, row);
+		if (!((_occupancy[density_index >> 6] >> (density_index & 63)) & 1)) {
+			return -1;
+		}
+		return _cell_record[density_index];
+	}
+
+	int64_t key = _sparse_cell_key(col, row);
+	size_t mask = _hash_keys.size() - 1;
+	size_t bucket = _sparse_cell_hash(key, mask);
+	while (_hash_keys[bucket] != -1) {
+		if (_hash_keys[bucket] == key) {
+			return _hash_records[bucket];
+		}
+		bucket = (bucket + 1) & mask;
+	}
+	return -1;
+}
+
+void DensityGrid::_grow_hash_table() {
+	std::vector<int64_t> old_keys = std::move(_hash_keys);
+	std::vector<int> old_records = std::move(_hash_records);
+	_hash_keys = std::vector<int64_t>(old_keys.size() * 2, -1);
+	_hash_records = std::vector<int>(old_keys.size() * 2, -1);
+	size_t mask = _hash_keys.size() - 1;
+	for (size_t i = 0; i < old_keys.size(); i++) {
+		if (old_keys[i] == -1) {
+			continue;
+		}
+		size_t bucket = _sparse_cell_hash(old_keys[i], mask);
+		while (_hash_keys[bucket] != -1) {
+			bucket = (bucket + 1) & mask;
+		}
+		_hash_keys[bucket] = old_keys[i];
+		_hash_records[bucket] = old_records[i];
+		_record_cell[old_records[i]] = (int) bucket;
+	}
+}
+
+int DensityGrid::_find_or_create_cell(int col, int row, double x, double y) {
+	int record = _find_cell(col, row);
+	if (record != -1) {
+		return record;
+	}
+
+	record = (int) _record_size.size();
+	_record_head.push_back(-1);
+	_record_tail.push_back(-1);
+	_record_size.push_back(0);
+	_record_bbox.insert(_record_bbox.end(), {(real_t) x, (real_t) y, (real_t) x, (real_t) y});
+	_stats.cells_used++;
+
+	if (!_sparse) {
+		int density_index = get_density_index(col, row);
+		_cell_record[density_index] = record;
+		_occupancy[density_index >> 6] |= ((uint64_t) 1) << (density_index & 63);
+		_record_cell.push_back(density_index);
+		return record;
+	}
+
+	// Keep the load factor of the hash table below 50%
+	if ((size_t) (_hash_used + 1) * 2 > _hash_keys.size()) {
+		_grow_hash_table();
+	}
+	int64_t key = _sparse_cell_key(col, row);
+	size_t mask = _hash_keys.size() - 1;
+	size_t bucket = _sparse_cell_hash(key, mask);
+	while (_hash_keys[bucket] != -1) {
+		bucket = (bucket + 1) & mask;
+	}
+	_hash_keys[bucket] = key;
+	_hash_records[bucket] = record;
+	_record_cell.push_back((int) bucket);
+	_hash_used++;
+	return record;
+}
+
+void DensityGrid::insert_coord(double x, double y) {
+	if (off_boundaries(x, y)) {
+		return;
+	}
+
+	int record = _find_or_create_cell(get_density_col(x), get_density_row(y), x, y);
+	int space_used = _record_size[record];
+	int slot = space_used % _cell_capacity;
+	if (slot == 0) {
+		// The cell is empty, or all of its slabs are full, so we take a new slab from the end of the buffer
+		int slab = _n_slabs;
+		_n_slabs++;
+		// After a `reset()`, the buffer still holds the slabs of the previous layout, which are simply overwritten
+		if ((size_t) _n_slabs * _cell_capacity > _slab_x.size()) {
+			_slab_x.resize((size_t) _n_slabs * _cell_capacity);
+			_slab_y.resize((size_t) _n_slabs * _cell_capacity);
+		}
+		_slab_next.push_back(-1);
+		if (space_used == 0) {
+			_record_head[record] = slab;
+		} else {
+			_slab_next[_record_tail[record]] = slab;
+			_stats.overflow_slabs++;
+		}
+		_record_tail[record] = slab;
+		_stats.slabs_allocated++;
+	}
+
+	size_t position = (size_t) _record_tail[record] * _cell_capacity + slot;
+	_slab_x[position] = x;
+	_slab_y[position] = y;
+
+	real_t* bbox = _record_bbox.data() + (size_t) record * 4;
+	bbox[0] = x < bbox[0] ? x : bbox[0];
+	bbox[1] = y < bbox[1] ? y : bbox[1];
+	bbox[2] = x > bbox[2] ? x : bbox[2];
+	bbox[3] = y > bbox[3] ? y : bbox[3];
+
+	_record_size[record]++;
+	_stats.points_inserted++;
+	if (_record_size[record] > _stats.max_cell_size) {
+		_stats.max_cell_size = _record_size[record];
+	}
+}
+
+void DensityGrid::insert_curve_coords(Curve* curve) {
+	int steps_taken = curve->_steps_taken;
+	for (int i = 0; i < steps_taken; i++) {
+		insert_coord(curve->_x[i], curve->_y[i]);
+	}
+}
+
+bool DensityGrid::is_valid_next_step(double x, double y) {
+	// The point is checked as it would be stored (e.g. the starting point of a curve, which comes from a seed point)
+	x = (real_t) x;
+	y = (real_t) y;
+	if (off_boundaries(x, y)) {
+		return 0;
+	}
+
+	int density_col = get_density_col(x);
+	int density_row = get_density_row(y);
+	int start_row = (density_row - 1) > 0 ? density_row - 1 : 0;
+	int end_row = (density_row + 1) < _height ? density_row + 1 : density_row;
+	int start_col = (density_col - 1) > 0 ? density_col - 1 : 0;
+	int end_col = (density_col + 1) < _width ? density_col + 1 : density_col;
+
+	for (int r = start_row; r <= end_row; r++) {
+		for (int c = start_col; c <= end_col; c++) {
+			int record;
+			if (!_sparse) {
+				// The occupancy bit alone tells whether the cell is empty, so the record of the cell
+				// is only loaded for the bounding box test, and it is not checked again
+				int density_index = get_density_index(c, r);
+				if (!((_occupancy[density_index >> 6] >> (density_index & 63)) & 1)) {
+					continue;
+				}
+				record = _cell_record[density_index];
+			} else {
+				record = _find_cell(c, r);
+				if (record == -1) {
+					continue;
+				}
+			}
+
+			// If even the closest corner of the bounding box of the cell is
+			// far enough, then, no point inside this cell can be too close
+			const real_t* bbox = _record_bbox.data() + (size_t) record * 4;
+			double dx = bbox[0] - x > x - bbox[2] ? bbox[0] - x : x - bbox[2];
+			double dy = bbox[1] - y > y - bbox[3] ? bbox[1] - y : y - bbox[3];
+			dx = dx > 0 ? dx : 0;
+			dy = dy > 0 ? dy : 0;
+			if ((dx * dx + dy * dy) > _d_test2) {
+				continue;
+			}
+
+			int n_elements = _record_size[record];
+			int slab = _record_head[record];
+			while (n_elements > 0) {
+				int n_slab_elements = n_elements < _cell_capacity ? n_elements : _cell_capacity;
+				size_t offset = (size_t) slab * _cell_capacity;
+				const real_t* xs = _slab_x.data() + offset;
+				const real_t* ys = _slab_y.data() + offset;
+				if (any_point_within(xs, ys, n_slab_elements, x, y, _d_test2)) {
+					return 0;
+				}
+				n_elements -= n_slab_elements;
+				slab = _slab_next[slab];
+			}
+		}
+	}
+
+	return 1;
+}
+
+/** Same as `is_valid_next_step(x, y)`, but the points of the grid that are equal to one of the points of `ignored` do not count.
+*
+* This is useful to continue a curve that is already stored in the grid: its last points are always too close to its next step.
+* The points of `ignored` must be given with the exact coordinates they have in the grid (e.g. taken from the `lefer::Curve`).
+* The close points are checked one by one, so keep `ignored` short.
+*/
+bool DensityGrid::is_valid_next_step(double x, double y, std::span<const Point> ignored) {
+	x = (real_t) x;
+	y = (real_t) y;
+	if (off_boundaries(x, y)) {
+		return 0;
+	}
+
+	int density_col = get_density_col(x);
+	int density_row = get_density_row(y);
+	for (int r = density_row - 1; r <= density_row + 1; r++) {
+		for (int c = density_col - 1; c <= density_col + 1; c++) {
+			if (r < 0 || c < 0 || r >= _height || c >= _width) {
+				continue;
+			}
+			int record = _find_cell(c, r);
+			if (record == -1) {
+				continue;
+			}
+
+			int n_elements = _record_size[record];
+			int slab = _record_head[record];
+			while (n_elements > 0) {
+				int n_slab_elements = n_elements < _cell_capacity ? n_elements : _cell_capacity;
+				size_t offset = (size_t) slab * _cell_capacity;
+				for (int i = 0; i < n_slab_elements; i++) {
+					double dx = _slab_x[offset + i] - x;
+					double dy = _slab_y[offset + i] - y;
+					if ((dx * dx + dy * dy) > _d_test2) {
+						continue;
+					}
+					bool is_ignored = false;
+					for (Point p: ignored) {
+						is_ignored = is_ignored || (p.x == (double) _slab_x[offset + i] && p.y == (double) _slab_y[offset + i]);
+					}
+					if (!is_ignored) {
+						return 0;
+					}
+				}
+				n_elements -= n_slab_elements;
+				slab = _slab_next[slab];
+			}
+		}
+	}
+
+	return 1;
+}
+
+/** Remove every point from the density grid, but keep the memory it already allocated.
+ *
+ * This is useful when you draw many layouts over fields of the same size, one after the other
+ * (e.g. the frames of an animation). Instead of building a new grid for each layout, you can reset
+ * the same grid, and the slabs (and the hash table of a sparse grid) are reused by the next layout.
+ *
+ * The grid keeps a list of the cells that received at least one point, so only these cells
+ * are cleared, and the cost of a reset is proportional to the area covered by the previous
+ * layout, not to the size of the grid.
+ */
+void DensityGrid::reset() {
+	for (int cell: _record_cell) {
+		if (_sparse) {
+			_hash_keys[cell] = -1;
+			_hash_records[cell] = -1;
+		} else {
+			_cell_record[cell] = -1;
+			_occupancy[cell >> 6] = 0;
+		}
+	}
+	_hash_used = 0;
+	_record_head.clear();
+	_record_tail.clear();
+	_record_size.clear();
+	_record_bbox.clear();
+	_record_cell.clear();
+	_slab_next.clear();
+	_n_slabs = 0;
+	_stats = {0, 0, 0, 0, 0};
 }
 
-void Curve::insert_step(double x_coord, double y_coord, int direction_id) {
-	_x.emplace_back(x_coord);
-	_y.emplace_back(y_coord);
-	_direction.emplace_back(direction_id);
-	_step_id.emplace_back(_steps_taken);
-	_steps_taken++;
+/** Remove every point from the density grid, and change its separation distance.
+ *
+ * The grid keeps the field size it was built for, and the memory it already allocated. A dense grid
+ * only allocates more memory if the new `d_sep` is smaller than any `d_sep` it used before.
+ *
+ * @param d_sep the new "separation distance" of the grid.
+ */
+void DensityGrid::reset(double d_sep) {
+	reset();
+	_set_geometry(d_sep);
+	if (!_sparse) {
+		// Every position is empty at this point, so the positions added by a smaller `d_sep` are empty as well
+		_cell_record.resize(_n_elements, -1);
+		_occupancy.resize((_n_elements + 63) / 64, 0);
+	}
 }
 
 
+/** Get the counters that describe the memory usage of the density grid.
+ *
+ * These counters are useful to tune the `cell_capacity` of the grid. If `overflow_slabs`
+ * is high, your cells are frequently growing beyond a single slab, and you might want
+ * to increase `cell_capacity`. If `max_cell_size` is much smaller than `cell_capacity`,
+ * then, you are wasting memory, and you can use a smaller `cell_capacity`.
+ */
+DensityGridStats DensityGrid::get_stats() {
+	return _stats;
+}
 
 
 
@@ -414,65 +2662,76 @@ void Curve::insert_step(double x_coord, double y_coord, int direction_id) {
 
 
 
-// DensityGrid class ============================================================================
 
 
-/** The constructor for DensityGrid class
+// ConcurrentDensityGrid class ====================================================================
+
+
+/** The constructor for ConcurrentDensityGrid class
  *
- * The Jobard and Lefer algortihm works around a "supporting" 2D grid, called of "density grid".
- * Each cell (or coordinate) in this density grid is responsible for keeping tracking of
- * curves that are already drawn into that specific area of the flow field.
+ * A `ConcurrentDensityGrid` offers the same interface as `lefer::DensityGrid` (`insert_coord()`,
+ * `insert_curve_coords()` and `is_valid_next_step()`), but it can be shared by many threads: any number of threads can insert
+ * points and check points at the same time.
  *
- * In the `cell_capacity` argument, you can specify an amount of space you want to pre-allocate
- * for each cell in the density grid before the algorithm starts to run. This might improve
- * drawstically the performance of the algorithm, because you avoid the need for frequents
- * resizing and reallocation of the `std::vector` objects that represents each cell.
+ * The points are stored in chains of slabs of `cell_capacity` entries, like in `lefer::DensityGrid`.
+ * Inserts into the same region of the grid (4x4 cells) are serialized by one of a fixed set of locks ("lock striping"),
+ * so threads that work in different areas of the field rarely wait for each other. Reads never take a lock: each point
+ * is written before the size of its cell is updated (with release semantics), so a reader that loads the size
+ * of a cell (with acquire semantics) only looks at points that are completely written. The slabs are never moved
+ * or freed while the grid is alive, so a reader can safely walk a chain of slabs while another thread extends it.
  *
- * In other words, if you pre-allocate enough space for each cell in the density grid,
- * then, the algorithm does not have to spend time resizing the cell every time it hits
- * the maximum capacity for that cell.
+ * Like a dense `lefer::DensityGrid`, this grid allocates a few bytes for every cell in the grid up front.
  *
  * @param flow_field_width the width of the flow field.
  * @param flow_field_height the height of the flow field.
 * @param d_sep the "separation distance", i.e., the amount of distance that each curve must be from neighbouring curves.
-* @param cell_capacity the capacity (or "space") you want to allocate for each cell in the density grid.
+* @param cell_capacity the number of points stored in each slab of the density grid.
 */
-DensityGrid::DensityGrid(int flow_field_width, int flow_field_height, double d_sep, int cell_capacity) {
-	int grid_width = (int)(flow_field_width / d_sep);
-	int grid_height = (int)(flow_field_height / d_sep);
+ConcurrentDensityGrid::ConcurrentDensityGrid(int flow_field_width, int flow_field_height, double d_sep, int cell_capacity) {
+	_width = (int)(flow_field_width / d_sep);
+	_height = (int)(flow_field_height / d_sep);
+	_n_elements = _width * _height;
 	_d_sep = d_sep;
-	_width = grid_width;
-	_height = grid_height;
-	_n_elements = grid_width * grid_height;
-	_grid.reserve(_n_elements);
-
+	_d_test = _d_sep - (0.01 * _d_sep);
+	_d_test2 = _d_test * _d_test;
+	_cell_capacity = cell_capacity > 0 ? cell_capacity : 1;
+	_cell_head = std::unique_ptr<std::atomic<int>[]>(new std::atomic<int>[_n_elements]);
+	_cell_size = std::unique_ptr<std::atomic<int>[]>(new std::atomic<int>[_n_elements]);
+	_cell_tail = std::unique_ptr<int[]>(new int[_n_elements]);
 	for (int i = 0; i < _n_elements; i++) {
-		DensityCell cell(cell_capacity);
-		_grid.push_back(cell);
+		_cell_head[i].store(-1, std::memory_order_relaxed);
+		_cell_size[i].store(0, std::memory_order_relaxed);
+		_cell_tail[i] = -1;
+	}
+	_locks = std::unique_ptr<std::mutex[]>(new std::mutex[N_LOCKS]);
+	for (int i = 0; i < N_SEGMENTS; i++) {
+		_segments[i].store(nullptr, std::memory_order_relaxed);
 	}
+	_n_slabs.store(0);
+	_n_points.store(0);
 }
 
-int DensityGrid::get_density_col (double x) {
+ConcurrentDensityGrid::~ConcurrentDensityGrid() {
+	for (int i = 0; i < N_SEGMENTS; i++) {
+		delete _segments[i].load();
+	}
+}
+
+int ConcurrentDensityGrid::get_density_col (double x) {
 	double c = (x / _d_sep);
 	return (int) c;
 }
 
-int DensityGrid::get_density_row (double y) {
+int ConcurrentDensityGrid::get_density_row (double y) {
 	double r = (y / _d_sep);
 	return (int) r;
 }
 
-int DensityGrid::get_density_index (double x, double y) {
-	int col = get_density_col(x);
-	int row = get_density_row(y);
-	return col + _width * row;
-}
-
-int DensityGrid::get_density_index (int col, int row) {
+int ConcurrentDensityGrid::get_density_index (int col, int row) {
 	return col + _width * row;
 }
 
-bool DensityGrid::off_boundaries(double x, double y) {
+bool ConcurrentDensityGrid::off_boundaries(double x, double y) {
 	int c = get_density_col(x);
 	int r = get_density_row(y);
 	return (
@@ -483,30 +2742,89 @@ bool DensityGrid::off_boundaries(double x, double y) {
 	);
 }
 
-void DensityGrid::insert_coord(double x, double y) {
+// Find the segment that stores a slab. The segment `k` stores `FIRST_SEGMENT_SLABS * 2^k` slabs
+ConcurrentSlabSegment* ConcurrentDensityGrid::_slab_segment(int slab, int* offset) {
+	unsigned int q = (unsigned int) (slab / FIRST_SEGMENT_SLABS) + 1;
+	int k = 0;
+	while ((q >> (k + 1)) != 0) {
+		k++;
+	}
+	*offset = slab - FIRST_SEGMENT_SLABS * ((1 << k) - 1);
+	return _segments[k].load(std::memory_order_acquire);
+}
+
+int ConcurrentDensityGrid::_allocate_slab() {
+	int slab = _n_slabs.fetch_add(1);
+	int offset;
+	if (_slab_segment(slab, &offset) != nullptr) {
+		return slab;
+	}
+
+	std::lock_guard<std::mutex> guard(_segments_lock);
+	unsigned int q = (unsigned int) (slab / FIRST_SEGMENT_SLABS) + 1;
+	int k = 0;
+	while ((q >> (k + 1)) != 0) {
+		k++;
+	}
+	if (_segments[k].load(std::memory_order_acquire) == nullptr) {
+		size_t n_slabs = (size_t) FIRST_SEGMENT_SLABS << k;
+		ConcurrentSlabSegment* segment = new ConcurrentSlabSegment();
+		segment->x = std::unique_ptr<real_t[]>(new real_t[n_slabs * _cell_capacity]);
+		segment->y = std::unique_ptr<real_t[]>(new real_t[n_slabs * _cell_capacity]);
+		segment->next = std::unique_ptr<std::atomic<int>[]>(new std::atomic<int>[n_slabs]);
+		for (size_t i = 0; i < n_slabs; i++) {
+			segment->next[i].store(-1, std::memory_order_relaxed);
+		}
+		_segments[k].store(segment, std::memory_order_release);
+	}
+	return slab;
+}
+
+void ConcurrentDensityGrid::insert_coord(double x, double y) {
 	if (off_boundaries(x, y)) {
 		return;
 	}
 
-	int density_index = get_density_index(x, y);
-	int space_used = _grid[density_index].space_used;
-	int capacity = _grid[density_index].capacity;
-
-	if ((space_used + 1) < capacity) {
-		_grid[density_index].x[space_used] = x;
-		_grid[density_index].y[space_used] = y;
-		_grid[density_index].space_used++;
+	int col = get_density_col(x);
+	int row = get_density_row(y);
+	int density_index = get_density_index(col, row);
+	int lock_index = ((row >> 2) * 61 + (col >> 2)) & (N_LOCKS - 1);
+	std::lock_guard<std::mutex> guard(_locks[lock_index]);
+
+	int space_used = _cell_size[density_index].load(std::memory_order_relaxed);
+	int slot = space_used % _cell_capacity;
+	int offset;
+	if (slot == 0) {
+		// The cell is empty, or all of its slabs are full
+		int slab = _allocate_slab();
+		if (space_used == 0) {
+			_cell_head[density_index].store(slab, std::memory_order_release);
+		} else {
+			ConcurrentSlabSegment* tail_segment = _slab_segment(_cell_tail[density_index], &offset);
+			tail_segment->next[offset].store(slab, std::memory_order_release);
+		}
+		_cell_tail[density_index] = slab;
 	}
+
+	ConcurrentSlabSegment* segment = _slab_segment(_cell_tail[density_index], &offset);
+	size_t position = (size_t) offset * _cell_capacity + slot;
+	segment->x[position] = x;
+	segment->y[position] = y;
+	// Publish the point to the readers
+	_cell_size[density_index].store(space_used + 1, std::memory_order_release);
+	_n_points.fetch_add(1, std::memory_order_relaxed);
 }
 
-void DensityGrid::insert_curve_coords(Curve* curve) {
+void ConcurrentDensityGrid::insert_curve_coords(Curve* curve) {
 	int steps_taken = curve->_steps_taken;
 	for (int i = 0; i < steps_taken; i++) {
-		insert_coord(curve->_x.at(i), curve->_y.at(i));
+		insert_coord(curve->_x[i], curve->_y[i]);
 	}
 }
 
-bool DensityGrid::is_valid_next_step(double x, double y) {
+bool ConcurrentDensityGrid::is_valid_next_step(double x, double y) {
+	x = (real_t) x;
+	y = (real_t) y;
 	if (off_boundaries(x, y)) {
 		return 0;
 	}
@@ -514,28 +2832,29 @@ bool DensityGrid::is_valid_next_step(double x, double y) {
 	int density_col = get_density_col(x);
 	int density_row = get_density_row(y);
 	int start_row = (density_row - 1) > 0 ? density_row - 1 : 0;
-	int end_row = (density_row + 1) < _width ? density_row + 1 : density_row; 
+	int end_row = (density_row + 1) < _height ? density_row + 1 : density_row;
 	int start_col = (density_col - 1) > 0 ? density_col - 1 : 0;
-	int end_col = (density_col + 1) < _height ? density_col + 1 : density_col;
+	int end_col = (density_col + 1) < _width ? density_col + 1 : density_col;
 
-	// Subtracting a very small amount from D_TEST, just to account for the lost of float precision
-	// that happens during the calculations below, specially in the distance calc
-	double d_test = _d_sep - (0.01 * _d_sep);
-	for (int c = start_col; c <= end_col; c++) {
-		for (int r = start_row; r <= end_row; r++) {
+	for (int r = start_row; r <= end_row; r++) {
+		for (int c = start_col; c <= end_col; c++) {
 			int density_index = get_density_index(c, r);
-			int n_elements = _grid[density_index].space_used;
+			int n_elements = _cell_size[density_index].load(std::memory_order_acquire);
 			if (n_elements == 0) {
 				continue;
 			}
 
-			for (int i = 0; i < n_elements; i++) {
-				double x2 = _grid[density_index].x.at(i);
-				double y2 = _grid[density_index].y.at(i);
-				double dist = distance(x, y, x2, y2);
-				if (dist <= d_test) {
+			int slab = _cell_head[density_index].load(std::memory_order_acquire);
+			while (n_elements > 0) {
+				int offset;
+				ConcurrentSlabSegment* segment = _slab_segment(slab, &offset);
+				int n_slab_elements = n_elements < _cell_capacity ? n_elements : _cell_capacity;
+				size_t position = (size_t) offset * _cell_capacity;
+				if (any_point_within(segment->x.get() + position, segment->y.get() + position, n_slab_elements, x, y, _d_test2)) {
 					return 0;
 				}
+				n_elements -= n_slab_elements;
+				slab = segment->next[offset].load(std::memory_order_acquire);
 			}
 		}
 	}
@@ -543,26 +2862,50 @@ bool DensityGrid::is_valid_next_step(double x, double y) {
 	return 1;
 }
 
+/** Get the number of points stored in the grid. */
+long ConcurrentDensityGrid::get_n_points() {
+	return _n_points.load();
+}
 
+/** Copy the points stored in a cell of the grid, in the order they were inserted.
+ *
+ * This is mostly useful to check the contents of the grid (e.g. in tests). Points inserted by other
+ * threads while the cell is being read may or may not be copied.
+ *
+ * @param col the column of the cell.
+ * @param row the row of the cell.
+ * @param points the vector that receives the points (it is cleared first). It stays empty for a cell outside the grid.
+ */
+void ConcurrentDensityGrid::get_cell_points(int col, int row, std::vector<Point>* points) {
+	points->clear();
+	if (col < 0 || row < 0 || col >= _width || row >= _height) {
+		return;
+	}
 
+	int density_index = get_density_index(col, row);
+	int n_elements = _cell_size[density_index].load(std::memory_order_acquire);
+	if (n_elements == 0) {
+		return;
+	}
+	int slab = _cell_head[density_index].load(std::memory_order_acquire);
+	while (n_elements > 0) {
+		int offset;
+		ConcurrentSlabSegment* segment = _slab_segment(slab, &offset);
+		int n_slab_elements = n_elements < _cell_capacity ? n_elements : _cell_capacity;
+		size_t position = (size_t) offset * _cell_capacity;
+		for (int i = 0; i < n_slab_elements; i++) {
+			points->push_back({segment->x[position + i], segment->y[position + i]});
+		}
+		n_elements -= n_slab_elements;
+		slab = segment->next[offset].load(std::memory_order_acquire);
+	}
+}
 
 
 
 
 
 
-// DensityCell class =============================================================================
-DensityCell::DensityCell(int cell_capacity) {
-	x = std::vector<double>(cell_capacity, 0.0);
-	y = std::vector<double>(cell_capacity, 0.0);
-	capacity = cell_capacity;
-	space_used = 0;
-}
-
-
-
- 
-
 
 
 
@@ -589,45 +2932,397 @@ void SeedPointsQueue::insert_point(Point p) {
 	_space_used++;
 }
 
+void SeedPointsQueue::clear() {
+	_points.clear();
+	_space_used = 0;
+}
 
 
-SeedPointsQueue collect_seedpoints (Curve* curve, double d_sep) {
-	int steps_taken = curve->_steps_taken;
-	SeedPointsQueue queue = SeedPointsQueue(steps_taken);
-	if (steps_taken == 0) {
-		return queue;
+
+SeedFrontier::SeedFrontier(SeedSchedule schedule, double centre_x, double centre_y) {
+	_schedule = schedule;
+	_head = 0;
+	_size = 0;
+	_centre_x = centre_x;
+	_centre_y = centre_y;
+	if (_schedule == SeedSchedule::fifo) {
+		_ring.resize(256);
+	}
+}
+
+bool SeedFrontier::is_empty() {
+	return size() == 0;
+}
+
+int SeedFrontier::size() {
+	if (_schedule == SeedSchedule::fifo) {
+		return _size;
+	}
+	return _heap.size();
+}
+
+static bool _is_farther_from_centre(const std::pair<double, Point>& a, const std::pair<double, Point>& b) {
+	return a.first > b.first;
+}
+
+void SeedFrontier::push(Point p) {
+	if (_schedule == SeedSchedule::fifo) {
+		int capacity = _ring.size();
+		if (_size == capacity) {
+			// Unroll the ring into a buffer twice as large
+			std::rotate(_ring.begin(), _ring.begin() + _head, _ring.end());
+			_ring.resize(capacity * 2);
+			_head = 0;
+		}
+		_ring[(_head + _size) & (_ring.size() - 1)] = p;
+		_size++;
+		return;
+	}
+
+	double dx = p.x - _centre_x;
+	double dy = p.y - _centre_y;
+	_heap.emplace_back(dx * dx + dy * dy, p);
+	std::push_heap(_heap.begin(), _heap.end(), _is_farther_from_centre);
+}
+
+Point SeedFrontier::pop() {
+	if (_schedule == SeedSchedule::fifo) {
+		Point p = _ring[_head];
+		_head = (_head + 1) & (_ring.size() - 1);
+		_size--;
+		return p;
+	}
+
+	std::pop_heap(_heap.begin(), _heap.end(), _is_farther_from_centre);
+	Point p = _heap.back().second;
+	_heap.pop_back();
+	return p;
+}
+
+void SeedFrontier::clear() {
+	_head = 0;
+	_size = 0;
+	_heap.clear();
+}
+
+/** Remove every seed point, and change the schedule and the centre of the frontier, but keep the memory it already allocated. */
+void SeedFrontier::reset(SeedSchedule schedule, double centre_x, double centre_y) {
+	clear();
+	_schedule = schedule;
+	_centre_x = centre_x;
+	_centre_y = centre_y;
+	if (_schedule == SeedSchedule::fifo && _ring.empty()) {
+		_ring.resize(256);
+	}
+}
+
+
+
+// The left and right seed points of each segment of a curve are the first point of the segment, moved by `d_sep`
+// along the normal of the segment. The normal is just the direction of the segment rotated by 90 degrees,
+// so no trigonometry is needed, only one square root and one division per segment.
+static inline void _seedpoints_kernel_body(const real_t* xs, const real_t* ys, int n_segments, double d_sep, Point* seeds) {
+	for (int i = 0; i < n_segments; i++) {
+		double x = xs[i];
+		double y = ys[i];
+		double dx = xs[i + 1] - x;
+		double dy = ys[i + 1] - y;
+		double length2 = dx * dx + dy * dy;
+		// A segment of length zero has no direction, so it takes the direction of the x axis (as `atan2(0, 0)` does)
+		dx = length2 > 0.0 ? dx : 1.0;
+		length2 = length2 > 0.0 ? length2 : 1.0;
+		double scale = d_sep / sqrt(length2);
+		double nx = -dy * scale;
+		double ny = dx * scale;
+		seeds[2 * i] = {x + nx, y + ny};
+		seeds[2 * i + 1] = {x - nx, y - ny};
+	}
+}
+
+typedef void (*SeedPointsKernel)(const real_t* xs, const real_t* ys, int n_segments, double d_sep, Point* seeds);
+
+static void _seedpoints_kernel_scalar(const real_t* xs, const real_t* ys, int n_segments, double d_sep, Point* seeds) {
+	_seedpoints_kernel_body(xs, ys, n_segments, d_sep, seeds);
+}
+
+#ifdef LEFER_X86_DISPATCH
+
+// The SIMD kernels compute the seed points in double precision, with the same operations (and in the same order)
+// as the scalar kernel, and without FMA, so the seed points are exactly the same on every CPU. The seed points
+// of each segment are stored as four doubles (left x, left y, right x, right y).
+static_assert(sizeof(Point) == 2 * sizeof(double), "the SIMD seed point kernels store a Point as two doubles");
+
+#ifdef LEFER_SINGLE_PRECISION
+
+__attribute__((target("sse2")))
+static inline __m128d _load_2_as_pd(const real_t* p) {
+	return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i*) p)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256d _load_4_as_pd(const real_t* p) {
+	return _mm256_cvtps_pd(_mm_loadu_ps(p));
+}
+
+#else
+
+__attribute__((target("sse2")))
+static inline __m128d _load_2_as_pd(const real_t* p) {
+	return _mm_loadu_pd(p);
+}
+
+__attribute__((target("avx2")))
+static inline __m256d _load_4_as_pd(const real_t* p) {
+	return _mm256_loadu_pd(p);
+}
+
+#endif
+
+// Two segments at a time
+__attribute__((target("sse2")))
+static void _seedpoints_kernel_sse2(const real_t* xs, const real_t* ys, int n_segments, double d_sep, Point* seeds) {
+	__m128d zero = _mm_setzero_pd();
+	__m128d one = _mm_set1_pd(1.0);
+	__m128d sign = _mm_set1_pd(-0.0);
+	__m128d vd = _mm_set1_pd(d_sep);
+	double* out = (double*) seeds;
+	int i = 0;
+	for (; i + 2 <= n_segments; i += 2) {
+		__m128d x = _load_2_as_pd(xs + i);
+		__m128d y = _load_2_as_pd(ys + i);
+		__m128d dx = _mm_sub_pd(_load_2_as_pd(xs + i + 1), x);
+		__m128d dy = _mm_sub_pd(_load_2_as_pd(ys + i + 1), y);
+		__m128d length2 = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+		__m128d has_length = _mm_cmpgt_pd(length2, zero);
+		dx = _mm_or_pd(_mm_and_pd(has_length, dx), _mm_andnot_pd(has_length, one));
+		length2 = _mm_or_pd(_mm_and_pd(has_length, length2), _mm_andnot_pd(has_length, one));
+		__m128d scale = _mm_div_pd(vd, _mm_sqrt_pd(length2));
+		__m128d nx = _mm_mul_pd(_mm_xor_pd(dy, sign), scale);
+		__m128d ny = _mm_mul_pd(dx, scale);
+		__m128d left_x = _mm_add_pd(x, nx);
+		__m128d left_y = _mm_add_pd(y, ny);
+		__m128d right_x = _mm_sub_pd(x, nx);
+		__m128d right_y = _mm_sub_pd(y, ny);
+		_mm_storeu_pd(out + 4 * i, _mm_unpacklo_pd(left_x, left_y));
+		_mm_storeu_pd(out + 4 * i + 2, _mm_unpacklo_pd(right_x, right_y));
+		_mm_storeu_pd(out + 4 * i + 4, _mm_unpackhi_pd(left_x, left_y));
+		_mm_storeu_pd(out + 4 * i + 6, _mm_unpackhi_pd(right_x, right_y));
 	}
+	_seedpoints_kernel_body(xs + i, ys + i, n_segments - i, d_sep, seeds + 2 * i);
+}
 
-	for (int i = 0; i < steps_taken - 1; i++) {
-		double x = curve->_x.at(i);
-		double y = curve->_y.at(i);
+// Four segments at a time
+__attribute__((target("avx2")))
+static void _seedpoints_kernel_avx2(const real_t* xs, const real_t* ys, int n_segments, double d_sep, Point* seeds) {
+	__m256d zero = _mm256_setzero_pd();
+	__m256d one = _mm256_set1_pd(1.0);
+	__m256d sign = _mm256_set1_pd(-0.0);
+	__m256d vd = _mm256_set1_pd(d_sep);
+	double* out = (double*) seeds;
+	int i = 0;
+	for (; i + 4 <= n_segments; i += 4) {
+		__m256d x = _load_4_as_pd(xs + i);
+		__m256d y = _load_4_as_pd(ys + i);
+		__m256d dx = _mm256_sub_pd(_load_4_as_pd(xs + i + 1), x);
+		__m256d dy = _mm256_sub_pd(_load_4_as_pd(ys + i + 1), y);
+		__m256d length2 = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+		__m256d has_length = _mm256_cmp_pd(length2, zero, _CMP_GT_OQ);
+		dx = _mm256_blendv_pd(one, dx, has_length);
+		length2 = _mm256_blendv_pd(one, length2, has_length);
+		__m256d scale = _mm256_div_pd(vd, _mm256_sqrt_pd(length2));
+		__m256d nx = _mm256_mul_pd(_mm256_xor_pd(dy, sign), scale);
+		__m256d ny = _mm256_mul_pd(dx, scale);
+		__m256d left_x = _mm256_add_pd(x, nx);
+		__m256d left_y = _mm256_add_pd(y, ny);
+		__m256d right_x = _mm256_sub_pd(x, nx);
+		__m256d right_y = _mm256_sub_pd(y, ny);
+		// Transpose the 4x4 block, so that each row holds the seed points of one segment
+		__m256d left_02 = _mm256_unpacklo_pd(left_x, left_y);
+		__m256d left_13 = _mm256_unpackhi_pd(left_x, left_y);
+		__m256d right_02 = _mm256_unpacklo_pd(right_x, right_y);
+		__m256d right_13 = _mm256_unpackhi_pd(right_x, right_y);
+		_mm256_storeu_pd(out + 4 * i, _mm256_permute2f128_pd(left_02, right_02, 0x20));
+		_mm256_storeu_pd(out + 4 * i + 4, _mm256_permute2f128_pd(left_13, right_13, 0x20));
+		_mm256_storeu_pd(out + 4 * i + 8, _mm256_permute2f128_pd(left_02, right_02, 0x31));
+		_mm256_storeu_pd(out + 4 * i + 12, _mm256_permute2f128_pd(left_13, right_13, 0x31));
+	}
+	_seedpoints_kernel_body(xs + i, ys + i, n_segments - i, d_sep, seeds + 2 * i);
+}
 
-		int ff_column_index = (int) floor(x);
-		int ff_row_index = (int) floor(y);
-		double angle = atan2(curve->_y.at(i + 1) - y, curve->_x.at(i + 1) - x);
+#endif
 
-		double angle_left = angle + (M_PI / 2);
-		double angle_right = angle - (M_PI / 2);
+static SeedPointsKernel _select_seedpoints_kernel() {
+#ifdef LEFER_X86_DISPATCH
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return _seedpoints_kernel_avx2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return _seedpoints_kernel_sse2;
+	}
+#endif
+	return _seedpoints_kernel_scalar;
+}
 
-		Point left_point = {
-			x + (d_sep * cos(angle_left)),
-			y + (d_sep * sin(angle_left))
-		};
-		Point right_point = {
-			x + (d_sep * cos(angle_right)),
-			y + (d_sep * sin(angle_right))
-		};
+// Selected on the first call, like `_proximity_kernel()`
+static SeedPointsKernel _seedpoints_kernel() {
+	static const SeedPointsKernel kernel = _select_seedpoints_kernel();
+	return kernel;
+}
 
-		queue.insert_point(left_point);	
-		queue.insert_point(right_point);	
+// The seed points of the curve whose points are `xs[0]`, `ys[0]` up to `xs[steps_taken - 1]`, `ys[steps_taken - 1]`
+static void _collect_seedpoints (const real_t* xs, const real_t* ys, int steps_taken, double d_sep, SeedPointsQueue* queue) {
+	int n_segments = steps_taken > 1 ? steps_taken - 1 : 0;
+	queue->_points.resize((size_t) n_segments * 2);
+	queue->_space_used = n_segments * 2;
+	if (n_segments > 0) {
+		_seedpoints_kernel()(xs, ys, n_segments, d_sep, queue->_points.data());
 	}
+}
 
+SeedPointsQueue collect_seedpoints (Curve* curve, double d_sep) {
+	SeedPointsQueue queue = SeedPointsQueue(curve->_steps_taken);
+	collect_seedpoints(curve, d_sep, &queue);
 	return queue;
 }
 
+/** Collect the seed points of a curve into an existing queue.
+ *
+ * The queue is emptied first, but it keeps its memory, so you can reuse the same queue
+ * for every curve of a layout, instead of allocating a new queue for each curve.
+ */
+void collect_seedpoints (Curve* curve, double d_sep, SeedPointsQueue* queue) {
+	_collect_seedpoints(curve->_x.data(), curve->_y.data(), curve->_steps_taken, d_sep, queue);
+}
+
+void collect_seedpoints (const CurveView& curve, double d_sep, SeedPointsQueue* queue) {
+	_collect_seedpoints(curve.x.data(), curve.y.data(), curve.steps_taken(), d_sep, queue);
+}
+
+/** Collect the seed points of a curve into an existing queue, keeping only the segments selected by `options`.
+ *
+ * With the default `options`, this is the same as the overload above. Otherwise, only one segment out of every
+ * `options.every_k_steps` segments, and only the segments that are at least `options.arc_spacing` units of arc
+ * away from the previous selected segment, produce seed points. The first segment of the curve is always selected.
+ */
+void collect_seedpoints (const CurveView& curve, double d_sep, SeedPointsQueue* queue, const SeedOptions& options) {
+	collect_seedpoints(curve, d_sep, queue);
+	if (options.every_k_steps <= 1 && options.arc_spacing <= 0.0) {
+		return;
+	}
+
+	int every_k_steps = options.every_k_steps > 1 ? options.every_k_steps : 1;
+	int n_segments = (int) queue->_points.size() / 2;
+	int n_kept = 0;
+	double arc = 0.0;
+	for (int i = 0; i < n_segments; i++) {
+		if (i > 0) {
+			double dx = curve.x[i] - curve.x[i - 1];
+			double dy = curve.y[i] - curve.y[i - 1];
+			arc += sqrt(dx * dx + dy * dy);
+		}
+		if (i % every_k_steps != 0 || (i > 0 && arc < options.arc_spacing)) {
+			continue;
+		}
+		queue->_points[2 * n_kept] = queue->_points[2 * i];
+		queue->_points[2 * n_kept + 1] = queue->_points[2 * i + 1];
+		n_kept++;
+		arc = 0.0;
+	}
+	queue->_points.resize((size_t) n_kept * 2);
+	queue->_space_used = n_kept * 2;
+}
+
+// The bucket of the hash table of `deduplicate_seedpoints()` where the probes for the cell (col, row) start
+static size_t _seed_cell_bucket(int64_t col, int64_t row, size_t mask) {
+	uint64_t h = (uint64_t) col * 0x9E3779B97F4A7C15ull ^ (uint64_t) row * 0xC2B2AE3D27D4EB4Full;
+	return (size_t) (h ^ (h >> 29)) & mask;
+}
+
+/** Drop the seed points that are within `d_sep` of a seed point kept earlier in the same queue.
+ *
+ * A curve drawn from the kept seed point would probably block the dropped one, so this saves a lot of
+ * probes with small steps, but it can change the layout. Each seed point is compared with every kept seed point
+ * of the queue, on both sides of the curve, so the seed points of a curve that turns back towards itself are also
+ * deduplicated. The kept seed points are found with a small hash table of `d_sep` cells.
+ *
+ * The remaining seed points keep their order, but they no longer alternate between the left and the right
+ * side of the curve (the frontier of `lefer::even_spaced_curves()` does not depend on that order).
+ * Seed points of other queues (i.e., of other curves) are not compared.
+ *
+ * @return the number of seed points dropped.
+ */
+int deduplicate_seedpoints (SeedPointsQueue* queue, double d_sep) {
+	std::vector<Point>& points = queue->_points;
+	if (d_sep <= 0.0 || points.size() < 2) {
+		return 0;
+	}
+
+	double d_sep2 = d_sep * d_sep;
+	// Open addressing with linear probing: each bucket stores the index of a kept seed point (-1 means empty).
+	// The probes for a cell visit every kept seed point of that cell before they reach an empty bucket.
+	size_t n_buckets = 16;
+	while (n_buckets < points.size() * 2) {
+		n_buckets *= 2;
+	}
+	size_t mask = n_buckets - 1;
+	std::vector<int> buckets(n_buckets, -1);
+	// The seed points of a queue alternate between the left and the right side of the curve, and the last seed point
+	// kept on the same side is the most likely to be too close, so it is tested before the hash table
+	int last_kept[2] = {-1, -1};
+	int n_kept = 0;
+	for (size_t i = 0; i < points.size(); i++) {
+		Point p = points[i];
+		int side = i % 2;
+		if (last_kept[side] != -1) {
+			double dx = points[last_kept[side]].x - p.x;
+			double dy = points[last_kept[side]].y - p.y;
+			if (dx * dx + dy * dy < d_sep2) {
+				continue;
+			}
+		}
+
+		int64_t col = (int64_t) floor(p.x / d_sep);
+		int64_t row = (int64_t) floor(p.y / d_sep);
+		bool too_close = false;
+		for (int64_t r = row - 1; r <= row + 1 && !too_close; r++) {
+			for (int64_t c = col - 1; c <= col + 1 && !too_close; c++) {
+				for (size_t b = _seed_cell_bucket(c, r, mask); buckets[b] != -1; b = (b + 1) & mask) {
+					Point kept = points[buckets[b]];
+					double dx = kept.x - p.x;
+					double dy = kept.y - p.y;
+					if (dx * dx + dy * dy < d_sep2) {
+						too_close = true;
+						break;
+					}
+				}
+			}
+		}
+		if (too_close) {
+			continue;
+		}
+
+		size_t b = _seed_cell_bucket(col, row, mask);
+		while (buckets[b] != -1) {
+			b = (b + 1) & mask;
+		}
+		buckets[b] = n_kept;
+		last_kept[side] = n_kept;
+		points[n_kept] = p;
+		n_kept++;
+	}
+	int n_dropped = (int) points.size() - n_kept;
+	points.resize(n_kept);
+	queue->_space_used = n_kept;
+	return n_dropped;
+}
+
 
 
 
 
 
+#ifdef LEFER_SINGLE_PRECISION
+} // inline namespace single_precision
+#endif
 } // namespace lefer
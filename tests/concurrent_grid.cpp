@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "lefer.hpp"
+
+
+// Many threads insert known points into the same `lefer::ConcurrentDensityGrid` at the same time.
+// Once they are done, the grid must store exactly the points that were inserted, no more and no less.
+
+static bool point_less(lefer::Point a, lefer::Point b) {
+	return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+// Run `worker(thread_id)` on `n_threads` threads, and wait for all of them
+template <typename Worker>
+static void run_threads(int n_threads, Worker worker) {
+	std::vector<std::thread> threads;
+	for (int t = 0; t < n_threads; t++) {
+		threads.emplace_back(worker, t);
+	}
+	for (std::thread& thread: threads) {
+		thread.join();
+	}
+}
+
+// Compare the points stored in the cells of the grid with `expected`, coordinate by coordinate
+static bool same_points(lefer::ConcurrentDensityGrid& grid, int field_width, int field_height, double d_sep, std::vector<lefer::Point> expected) {
+	std::vector<lefer::Point> stored;
+	std::vector<lefer::Point> cell;
+	for (int row = 0; row <= (int) (field_height / d_sep); row++) {
+		for (int col = 0; col <= (int) (field_width / d_sep); col++) {
+			grid.get_cell_points(col, row, &cell);
+			stored.insert(stored.end(), cell.begin(), cell.end());
+		}
+	}
+	// The grid stores the points rounded to `lefer::real_t`
+	for (lefer::Point& p: expected) {
+		p = {(double) (lefer::real_t) p.x, (double) (lefer::real_t) p.y};
+	}
+	std::sort(stored.begin(), stored.end(), point_less);
+	std::sort(expected.begin(), expected.end(), point_less);
+	if (stored.size() != expected.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < stored.size(); i++) {
+		if (stored[i].x != expected[i].x || stored[i].y != expected[i].y) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// The threads insert the points of a lattice, `2.5 * d_sep` apart, and each point lands in its own cell.
+// A query just inside `d_sep` of a point is then too close to that point only, so it fails only if the point was stored.
+static bool separated_points(int n_threads) {
+	int field_width = 300;
+	int field_height = 300;
+	double d_sep = 0.8;
+	double spacing = 2.5 * d_sep;
+	lefer::ConcurrentDensityGrid grid = lefer::ConcurrentDensityGrid(field_width, field_height, d_sep, 2);
+	std::vector<lefer::Point> points;
+	for (double y = 2.0 * d_sep; y < field_height - 2.0 * d_sep; y += spacing) {
+		for (double x = 2.0 * d_sep; x < field_width - 2.0 * d_sep; x += spacing) {
+			points.push_back({x + 0.1 * (points.size() % 3), y});
+		}
+	}
+
+	// Neighbouring points go to different threads, so the threads work on the same area of the grid
+	run_threads(n_threads, [&](int thread_id) {
+		for (size_t i = thread_id; i < points.size(); i += n_threads) {
+			grid.insert_coord(points[i].x, points[i].y);
+		}
+	});
+
+	long missing = 0;
+	for (lefer::Point p: points) {
+		missing += grid.is_valid_next_step(p.x + 0.9 * d_sep, p.y);
+	}
+	bool exact = same_points(grid, field_width, field_height, d_sep, points);
+	bool ok = missing == 0 && exact && grid.get_n_points() == (long) points.size();
+	std::cout << n_threads << " threads, separated points: " << points.size() << " inserted, " << grid.get_n_points() << " counted, "
+		<< missing << " not found" << (exact ? "" : ", stored points differ") << (ok ? "" : " (FAILED)") << std::endl;
+	return ok;
+}
+
+// All threads append points to the same few cells, so the cells grow by many slabs at the same time
+static bool crowded_points(int n_threads, int points_per_thread) {
+	int field_width = 300;
+	int field_height = 300;
+	double d_sep = 0.8;
+	lefer::ConcurrentDensityGrid grid = lefer::ConcurrentDensityGrid(field_width, field_height, d_sep, 4);
+	std::vector<std::vector<lefer::Point>> points(n_threads);
+	for (int t = 0; t < n_threads; t++) {
+		for (int i = 0; i < points_per_thread; i++) {
+			// Every thread inserts different points in the same 3x3 cells
+			double x = 100.0 + ((i * 7 + t) % 240) * 0.01;
+			double y = 100.0 + ((i * 13 + t * 5) % 240) * 0.01 + t * 1e-4;
+			points[t].push_back({x, y});
+		}
+	}
+
+	run_threads(n_threads, [&](int thread_id) {
+		for (lefer::Point p: points[thread_id]) {
+			grid.insert_coord(p.x, p.y);
+		}
+	});
+
+	std::vector<lefer::Point> all_points;
+	for (const std::vector<lefer::Point>& thread_points: points) {
+		all_points.insert(all_points.end(), thread_points.begin(), thread_points.end());
+	}
+	bool exact = same_points(grid, field_width, field_height, d_sep, all_points);
+	bool ok = exact && grid.get_n_points() == (long) all_points.size();
+	std::cout << n_threads << " threads, crowded points: " << all_points.size() << " inserted, " << grid.get_n_points() << " counted"
+		<< (exact ? "" : ", stored points differ") << (ok ? "" : " (FAILED)") << std::endl;
+	return ok;
+}
+
+int main () {
+	bool ok = true;
+	int thread_counts[] = {1, 4, 16};
+	for (int n_threads: thread_counts) {
+		for (int round = 0; round < 5; round++) {
+			ok = separated_points(n_threads) && ok;
+			ok = crowded_points(n_threads, 20000) && ok;
+		}
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+// Measurements of a layout shared by the tests and by the `precision` example. Include it after "lefer.hpp".
+// It can be included by units built with either precision of the library: the `lefer` types of each precision live in
+// their own namespace, so each unit gets its own overloads of the functions that take them.
+#include <math.h>
+
+#include <vector>
+
+
+//! The points of many curves, one curve after the other, stored as `double` whatever the precision of the library
+struct TracedCurves {
+	std::vector<double> x;
+	std::vector<double> y;
+	//! The points of the curve `i` are at the positions `offsets[i]` up to `offsets[i + 1] - 1` of `x` and `y`
+	std::vector<size_t> offsets;
+};
+
+
+//! How far the curves of two `TracedCurves` drawn from the same seed points are from each other
+struct CurveDeviation {
+	double max_deviation;
+	double mean_deviation;
+	//! The number of curves that have the same number of points in both sets
+	int n_same_length;
+};
+
+
+// The smallest distance between two points of different curves, found with a simple grid of `d_sep` cells
+inline double min_distance_between_curves(const lefer::CurveSet& curves, int field_width, int field_height, double d_sep) {
+	int grid_width = (int) (field_width / d_sep) + 1;
+	int grid_height = (int) (field_height / d_sep) + 1;
+	std::vector<std::vector<int>> cells((size_t) grid_width * grid_height);
+	std::vector<int> owner(curves.n_points());
+	for (int c = 0; c < curves.size(); c++) {
+		for (size_t i = curves._offsets[c]; i < curves._offsets[c + 1]; i++) {
+			owner[i] = c;
+			int col = (int) (curves._x[i] / d_sep);
+			int row = (int) (curves._y[i] / d_sep);
+			cells[(size_t) col + (size_t) grid_width * row].push_back((int) i);
+		}
+	}
+
+	double min_distance2 = 1e300;
+	for (size_t i = 0; i < curves.n_points(); i++) {
+		int col = (int) (curves._x[i] / d_sep);
+		int row = (int) (curves._y[i] / d_sep);
+		for (int r = row - 1; r <= row + 1; r++) {
+			for (int c = col - 1; c <= col + 1; c++) {
+				if (r < 0 || c < 0 || r >= grid_height || c >= grid_width) {
+					continue;
+				}
+				for (int j: cells[(size_t) c + (size_t) grid_width * r]) {
+					if (owner[j] == owner[i]) {
+						continue;
+					}
+					double dx = (double) curves._x[j] - curves._x[i];
+					double dy = (double) curves._y[j] - curves._y[i];
+					min_distance2 = dx * dx + dy * dy < min_distance2 ? dx * dx + dy * dy : min_distance2;
+				}
+			}
+		}
+	}
+	return sqrt(min_distance2);
+}
+
+// The curves drawn from each pair of coordinates of `seeds` on an empty field, with up to 200 steps of 1.2 units
+inline TracedCurves trace_from_seeds(lefer::FlowField* flow_field, const std::vector<double>& seeds, double d_sep) {
+	TracedCurves traced;
+	lefer::DensityGrid empty_grid = lefer::DensityGrid(flow_field->get_field_width(), flow_field->get_field_height(), d_sep, 16);
+	traced.offsets.push_back(0);
+	for (size_t s = 0; s + 1 < seeds.size(); s += 2) {
+		lefer::Curve curve = lefer::draw_curve(0, seeds[s], seeds[s + 1], 200, 1.2, d_sep, flow_field, &empty_grid);
+		traced.x.insert(traced.x.end(), curve._x.begin(), curve._x.end());
+		traced.y.insert(traced.y.end(), curve._y.begin(), curve._y.end());
+		traced.offsets.push_back(traced.x.size());
+	}
+	return traced;
+}
+
+// Compare the curves drawn from the same seed points, point by point, while both curves exist
+inline CurveDeviation compare_traced_curves(const TracedCurves& a, const TracedCurves& b) {
+	CurveDeviation result = {0.0, 0.0, 0};
+	double sum_deviation = 0.0;
+	long n_compared = 0;
+	for (size_t c = 0; c + 1 < a.offsets.size(); c++) {
+		size_t n_a = a.offsets[c + 1] - a.offsets[c];
+		size_t n_b = b.offsets[c + 1] - b.offsets[c];
+		result.n_same_length += n_a == n_b;
+		size_t n = n_a < n_b ? n_a : n_b;
+		for (size_t i = 0; i < n; i++) {
+			double dx = a.x[a.offsets[c] + i] - b.x[b.offsets[c] + i];
+			double dy = a.y[a.offsets[c] + i] - b.y[b.offsets[c] + i];
+			double deviation = sqrt(dx * dx + dy * dy);
+			result.max_deviation = deviation > result.max_deviation ? deviation : result.max_deviation;
+			sum_deviation += deviation;
+			n_compared++;
+		}
+	}
+	result.mean_deviation = n_compared > 0 ? sum_deviation / n_compared : 0.0;
+	return result;
+}
@@ -0,0 +1,123 @@
+#include <iostream>
+#include <vector>
+
+#include "lefer.hpp"
+#include "wave_field.hpp"
+
+
+// The parallel modes must produce exactly the same curves, no matter how many threads they use
+
+static bool same_layout(std::vector<lefer::Curve>& a, std::vector<lefer::Curve>& b) {
+	if (a.size() != b.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < a.size(); i++) {
+		if (a[i]._curve_id != b[i]._curve_id ||
+		    a[i]._x != b[i]._x ||
+		    a[i]._y != b[i]._y ||
+		    a[i]._direction != b[i]._direction) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int main () {
+	int field_width = 300;
+	int field_height = 300;
+	int n_curves = 100000;
+	int n_steps = 30;
+	int min_steps_allowed = 5;
+	double step_length = 1.2;
+	double d_sep = 0.8;
+	lefer::FlowField flow_field = lefer::FlowField(wave_field(field_width, field_height), field_width, field_height);
+	flow_field.precompute_directions();
+
+	bool all_ok = true;
+	std::vector<lefer::Curve> tiled_reference;
+	std::vector<lefer::Curve> speculative_reference;
+	int thread_counts[] = {1, 2, 8, 32};
+	for (int n_threads: thread_counts) {
+		lefer::DensityGrid tiled_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+		std::vector<lefer::Curve> tiled = lefer::parallel_even_spaced_curves(
+			45.0, 24.0, n_curves, n_steps, min_steps_allowed, step_length, d_sep, &flow_field, &tiled_grid, n_threads
+		);
+		lefer::DensityGrid speculative_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+		std::vector<lefer::Curve> speculative = lefer::speculative_even_spaced_curves(
+			45.0, 24.0, n_curves, n_steps, min_steps_allowed, step_length, d_sep, &flow_field, &speculative_grid, n_threads
+		);
+		if (n_threads == 1) {
+			tiled_reference = tiled;
+			speculative_reference = speculative;
+			std::cout << "1 thread: " << tiled.size() << " tiled curves, " << speculative.size() << " speculative curves" << std::endl;
+			continue;
+		}
+
+		bool ok = same_layout(tiled, tiled_reference) && same_layout(speculative, speculative_reference);
+		all_ok = all_ok && ok;
+		std::cout << n_threads << " threads: " << (ok ? "identical to 1 thread" : "DIFFERENT from 1 thread") << std::endl;
+	}
+
+	// A batch size below 1 must behave like a batch size of 1 (it used to loop forever)
+	std::vector<lefer::Curve> batch_reference;
+	int batch_sizes[] = {1, 0, -3};
+	for (int batch_size: batch_sizes) {
+		lefer::DensityGrid density_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+		std::vector<lefer::Curve> speculative = lefer::speculative_even_spaced_curves(
+			45.0, 24.0, n_curves, n_steps, min_steps_allowed, step_length, d_sep, &flow_field, &density_grid, 4, batch_size
+		);
+		if (batch_size == 1) {
+			batch_reference = speculative;
+			continue;
+		}
+
+		bool ok = same_layout(speculative, batch_reference);
+		all_ok = all_ok && ok;
+		std::cout << "batch size " << batch_size << ": " << (ok ? "identical to batch size 1" : "DIFFERENT from batch size 1") << std::endl;
+	}
+
+	// The threads of a batch reuse their grid and buffers between jobs, so a small job that comes after a
+	// large one must still get the same curves as when it is drawn on its own
+	std::vector<lefer::CurveJob> jobs;
+	int job_n_curves[] = {n_curves, 50, n_curves, 1, 400};
+	for (int job_curves: job_n_curves) {
+		jobs.push_back({&flow_field, 45.0, 24.0, job_curves, n_steps, min_steps_allowed, step_length, d_sep});
+	}
+	jobs[1].d_sep = 1.5;
+	jobs[4].n_steps = 60;
+	// Jobs with other seed options (and their seed counters) must also match the same layout drawn on its own
+	lefer::CurveJob seeded_job = {&flow_field, 45.0, 24.0, n_curves, n_steps, min_steps_allowed, step_length, d_sep};
+	seeded_job.seed_options.deduplicate = true;
+	seeded_job.seed_options.reseed = true;
+	seeded_job.seed_options.schedule = lefer::SeedSchedule::centre_first;
+	jobs.push_back(seeded_job);
+	seeded_job.seed_options = lefer::SeedOptions();
+	seeded_job.seed_options.every_k_steps = 3;
+	seeded_job.seed_options.arc_spacing = d_sep;
+	jobs.push_back(seeded_job);
+	std::vector<lefer::SeedStats> batch_stats(jobs.size());
+	for (size_t i = 0; i < jobs.size(); i++) {
+		jobs[i].seed_stats = &batch_stats[i];
+	}
+	std::vector<std::vector<lefer::Curve>> batch_results(jobs.size());
+	lefer::even_spaced_curves_batch(jobs, 2, 16, [&](int job_index, std::vector<lefer::Curve>&& curves) {
+		batch_results[job_index] = std::move(curves);
+	});
+	for (size_t i = 0; i < jobs.size(); i++) {
+		const lefer::CurveJob& job = jobs[i];
+		lefer::DensityGrid density_grid = lefer::DensityGrid(field_width, field_height, job.d_sep, 16);
+		lefer::SeedStats stats;
+		std::vector<lefer::Curve> alone = lefer::even_spaced_curves(
+			job.x_start, job.y_start, job.n_curves, job.n_steps, job.min_steps_allowed, job.step_length, job.d_sep,
+			job.flow_field, &density_grid, job.sampling, job.integrator, job.seed_options, &stats
+		);
+		bool ok = same_layout(batch_results[i], alone) &&
+			  batch_stats[i].generated == stats.generated &&
+			  batch_stats[i].pre_rejected == stats.pre_rejected &&
+			  batch_stats[i].traced == stats.traced &&
+			  batch_stats[i].reseeded == stats.reseeded;
+		all_ok = all_ok && ok;
+		std::cout << "batch job " << i << ": " << (ok ? "identical to the job on its own" : "DIFFERENT from the job on its own") << std::endl;
+	}
+	return all_ok ? 0 : 1;
+}
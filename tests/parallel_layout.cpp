@@ -0,0 +1,90 @@
+#include <math.h>
+
+#include <iostream>
+#include <vector>
+
+#include "lefer.hpp"
+#include "wave_field.hpp"
+
+
+// `parallel_even_spaced_curves()` keeps the `d_sep` distance between all curves of the field, and continues
+// the curves that leave the halo of their tile in the neighbouring tiles. This test checks the distance over the
+// whole layout, that the curves continued across tiles are still unbroken paths, and that the layout is not much
+// more fragmented than the sequential one.
+
+// Inserts the curves one after the other into an empty grid, and checks each of them against the curves before it
+static bool keeps_d_sep(const std::vector<lefer::Curve>& curves, int field_width, int field_height, double d_sep) {
+	lefer::DensityGrid density_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+	for (const lefer::Curve& curve: curves) {
+		for (int i = 0; i < curve._steps_taken; i++) {
+			if (!density_grid.is_valid_next_step(curve._x[i], curve._y[i])) {
+				std::cout << "curve " << curve._curve_id << " is too close to another curve at ("
+					<< curve._x[i] << ", " << curve._y[i] << ")" << std::endl;
+				return false;
+			}
+		}
+		lefer::Curve copy = curve;
+		density_grid.insert_curve_coords(&copy);
+	}
+	return true;
+}
+
+int main () {
+	int field_width = 200;
+	int field_height = 200;
+	int n_steps = 60;
+	double step_length = 0.5;
+	double d_sep = 0.8;
+	double tile_size = 20.0;
+	lefer::FlowField flow_field = lefer::FlowField(wave_field(field_width, field_height), field_width, field_height);
+
+	lefer::DensityGrid density_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16);
+	std::vector<lefer::Curve> sequential = lefer::even_spaced_curves(
+		100.0, 100.0, 1000000, n_steps, 5, step_length, d_sep, &flow_field, &density_grid
+	);
+	density_grid.reset();
+	std::vector<lefer::Curve> tiled = lefer::parallel_even_spaced_curves(
+		100.0, 100.0, 1000000, n_steps, 5, step_length, d_sep, &flow_field, &density_grid, 4, tile_size
+	);
+	std::cout << "sequential: " << sequential.size() << " curves, tiled: " << tiled.size() << " curves" << std::endl;
+
+	bool ok = keeps_d_sep(tiled, field_width, field_height, d_sep);
+
+	// With the Euler integrator, two consecutive points of a curve are always one step apart
+	int n_crossing = 0;
+	double halo = (tile_size - 2.0 * d_sep) / 2.0 - step_length;
+	for (size_t c = 0; c < tiled.size() && ok; c++) {
+		const lefer::Curve& curve = tiled[c];
+		if (curve._steps_taken > n_steps) {
+			std::cout << "curve " << c << " has " << curve._steps_taken << " points" << std::endl;
+			ok = false;
+		}
+		for (int i = 1; i < curve._steps_taken && ok; i++) {
+			double dx = curve._x[i] - curve._x[i - 1];
+			double dy = curve._y[i] - curve._y[i - 1];
+			if (fabs(sqrt(dx * dx + dy * dy) - step_length) > 1e-6) {
+				std::cout << "curve " << c << " is broken at (" << curve._x[i] << ", " << curve._y[i] << ")" << std::endl;
+				ok = false;
+			}
+		}
+
+		// Same halo as `parallel_even_spaced_curves()`. The last point of a curve can be one step beyond it.
+		double x_min = floor(curve._x[curve._seed_index] / tile_size) * tile_size - halo - step_length;
+		double y_min = floor(curve._y[curve._seed_index] / tile_size) * tile_size - halo - step_length;
+		double x_max = x_min + tile_size + 2.0 * (halo + step_length);
+		double y_max = y_min + tile_size + 2.0 * (halo + step_length);
+		for (int i = 0; i < curve._steps_taken; i++) {
+			if (curve._x[i] < x_min || curve._y[i] < y_min || curve._x[i] > x_max || curve._y[i] > y_max) {
+				n_crossing++;
+				break;
+			}
+		}
+	}
+	std::cout << n_crossing << " curves continued beyond the halo of their tile" << std::endl;
+	if (n_crossing == 0 || tiled.size() > 1.1 * sequential.size()) {
+		ok = false;
+	}
+
+	std::cout << (ok ? "ok" : "FAILED") << std::endl;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,58 @@
+#include <iostream>
+#include <vector>
+
+#include "lefer.hpp"
+#include "wave_field.hpp"
+#include "curve_checks.hpp"
+
+
+// The single-precision build (`lefer_float`) must keep the curves of a layout at least `d_sep` apart
+// (minus the 1% tolerance of the density grid), even though it stores every point rounded to `float`,
+// and its curves must stay close to the ones of the double-precision build
+
+// Defined in `precision_reference.cpp`, which is built with the double-precision library
+TracedCurves trace_double_precision(int field_width, int field_height, const std::vector<double>& seeds, double d_sep);
+
+static bool check_separation(lefer::FlowField* flow_field, int field_width, int field_height, double d_sep, bool sparse) {
+	lefer::DensityGrid density_grid = lefer::DensityGrid(field_width, field_height, d_sep, 16, sparse);
+	lefer::CurveSet curves = lefer::even_spaced_curve_set(45.0, 24.0, 1000000, 30, 5, 1.2, d_sep, flow_field, &density_grid);
+	double min_distance = min_distance_between_curves(curves, field_width, field_height, d_sep);
+	bool ok = min_distance >= 0.99 * d_sep;
+	std::cout << "d_sep " << d_sep << (sparse ? ", sparse grid: " : ", dense grid: ")
+		<< curves.size() << " curves, min distance between curves " << min_distance
+		<< (ok ? "" : " (FAILED)") << std::endl;
+	return ok;
+}
+
+int main () {
+	static_assert(sizeof(lefer::real_t) == sizeof(float), "precision.cpp must be built with LEFER_SINGLE_PRECISION");
+
+	int field_width = 600;
+	int field_height = 600;
+	lefer::FlowField flow_field = lefer::FlowField(wave_field(field_width, field_height), field_width, field_height);
+	flow_field.precompute_directions();
+
+	// Curves of 200 steps drawn from the same seed points, on an empty field, drift apart by less than 1e-3 units
+	int n_seeds = 2000;
+	double d_sep = 0.8;
+	std::vector<double> seeds;
+	unsigned int state = 12345;
+	for (int i = 0; i < n_seeds * 2; i++) {
+		state = state * 1664525u + 1013904223u;
+		seeds.push_back((state >> 8) * ((i % 2 == 0 ? field_width : field_height) / 16777216.0));
+	}
+	TracedCurves reference = trace_double_precision(field_width, field_height, seeds, d_sep);
+	TracedCurves single = trace_from_seeds(&flow_field, seeds, d_sep);
+	CurveDeviation deviation = compare_traced_curves(reference, single);
+	bool ok = deviation.max_deviation < 1e-3 && deviation.n_same_length >= 0.99 * n_seeds;
+	std::cout << "float vs double: mean deviation " << deviation.mean_deviation << ", max deviation " << deviation.max_deviation
+		<< ", " << deviation.n_same_length << " of " << n_seeds << " curves with the same number of points"
+		<< (ok ? "" : " (FAILED)") << std::endl;
+
+	double separations[] = {0.8, 1.7, 3.0};
+	for (double d_sep: separations) {
+		ok = check_separation(&flow_field, field_width, field_height, d_sep, false) && ok;
+		ok = check_separation(&flow_field, field_width, field_height, d_sep, true) && ok;
+	}
+	return ok ? 0 : 1;
+}
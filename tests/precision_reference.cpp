@@ -0,0 +1,11 @@
+// The double-precision side of the `precision` test (see `precision.cpp`)
+#include "lefer.hpp"
+#include "wave_field.hpp"
+#include "curve_checks.hpp"
+
+
+TracedCurves trace_double_precision(int field_width, int field_height, const std::vector<double>& seeds, double d_sep) {
+	lefer::FlowField flow_field = lefer::FlowField(wave_field(field_width, field_height), field_width, field_height);
+	flow_field.precompute_directions();
+	return trace_from_seeds(&flow_field, seeds, d_sep);
+}
@@ -0,0 +1,13 @@
+// A smooth flow field shared by the tests, so they do not depend on the noise library of the examples.
+// Include it after "lefer.hpp".
+
+
+static std::vector<lefer::real_t> wave_field(int field_width, int field_height) {
+	std::vector<lefer::real_t> angles(field_width * field_height);
+	for (int y = 0; y < field_height; y++) {
+		for (int x = 0; x < field_width; x++) {
+			angles[x + field_width * y] = sin(x * 0.05) * 2.0 + cos(y * 0.07) * 1.5;
+		}
+	}
+	return angles;
+}